@@ -0,0 +1,70 @@
+// Converts a directory of pcd frames into a single replay archive (io/replayArchive.h)
+
+#include <iostream>
+#include <chrono>
+#include "io/frameStream.h"
+
+int main (int argc, char** argv)
+{
+    if (argc != 3)
+    {
+        std::cerr << "usage: archive <pcd directory> <output archive>\n"
+                  << "  e.g. archive ../src/sensors/data/pcd/data_2 data_2.pcdseq" << std::endl;
+        return 2;
+    }
+    const std::string directory = argv[1];
+    const std::string output = argv[2];
+
+    FrameStream<pcl::PointXYZI> stream;
+    if (!boost::filesystem::is_directory(directory) || !stream.open(directory))
+    {
+        std::cerr << "no pcd directory " << directory << std::endl;
+        return 1;
+    }
+
+    auto startTime = std::chrono::steady_clock::now();
+
+    ReplayArchiveWriter writer;
+    if (!writer.open(output))
+    {
+        std::cerr << "cannot write " << output << std::endl;
+        return 1;
+    }
+    pcl::PointCloud<pcl::PointXYZI> cloud;
+    std::size_t totalPoints = 0;
+    for (std::size_t frame = 0; frame < stream.size(); ++frame)
+    {
+        stream.prefetch(frame + 1);
+        if (!stream.load(frame, cloud))
+        {
+            std::cerr << "skipping unreadable " << stream.name(frame) << std::endl;
+            continue;
+        }
+        const std::string name = boost::filesystem::path(stream.name(frame)).filename().string();
+        if (!writer.addFrame(cloud, name))
+        {
+            std::cerr << "write failed at " << name << std::endl;
+            return 1;
+        }
+        totalPoints += cloud.points.size();
+    }
+    if (!writer.close())
+    {
+        std::cerr << "write failed closing " << output << std::endl;
+        return 1;
+    }
+
+    // read it back the way the replay loop will
+    ReplayArchive archive;
+    if (!archive.open(output) || archive.size() != writer.size())
+    {
+        std::cerr << output << " does not read back" << std::endl;
+        return 1;
+    }
+
+    auto endTime = std::chrono::steady_clock::now();
+    auto elapsedTime = std::chrono::duration_cast<std::chrono::microseconds>(endTime - startTime);
+    std::cout << "archived " << archive.size() << " frames, " << totalPoints << " points, "
+              << boost::filesystem::file_size(output) / (1024.0 * 1024.0) << " MB in " << elapsedTime.count() / 1000.0 << " milliseconds" << std::endl;
+    return 0;
+}
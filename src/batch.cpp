@@ -0,0 +1,367 @@
+// Headless run of the cityBlock detection chain over every frame of a pcd directory,
+// writing per frame and aggregate timings as JSON or CSV
+
+#include "processPointClouds.h"
+// using templates for processPointClouds so also include .cpp to help linker
+#include "processPointClouds.cpp"
+#include "obstacleStages.h"
+#include "common/pipeline.h"
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+#include <algorithm>
+#include <cstring>
+
+// Stage times of one frame in milliseconds, with what it detected
+struct FrameTiming
+{
+    std::string path;
+    int points = 0;
+    double loadMs = 0;
+    double filterMs = 0;
+    double segmentMs = 0;
+    double clusterMs = 0;
+    int clusters = 0;
+
+    double totalMs() const { return loadMs + filterMs + segmentMs + clusterMs; }
+};
+
+struct BatchFrame
+{
+    ObstacleFrame frame;
+    FrameTiming timing;
+};
+
+struct BatchOptions
+{
+    // pcd directory or replay archive
+    std::string dataPath = "../src/sensors/data/pcd/data_1";
+    std::string format = "json";
+    std::string output;
+    int threads = 1;
+    bool pipelined = false;
+    bool haveSeed = false;
+    unsigned seed = 0;
+    // directory the filtered, obstacle and ground clouds of every frame are written to
+    std::string recordPath;
+    RecorderOptions recorder;
+};
+
+struct TimingSummary
+{
+    double mean;
+    double p50;
+    double p99;
+    double max;
+};
+
+double elapsedMs(std::chrono::steady_clock::time_point startTime)
+{
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - startTime).count();
+}
+
+// nearest rank percentiles
+TimingSummary summarize(std::vector<double> values)
+{
+    TimingSummary summary = {0, 0, 0, 0};
+    if(values.empty())
+        return summary;
+    std::sort(values.begin(), values.end());
+    for(double value : values)
+        summary.mean += value;
+    summary.mean /= values.size();
+    auto rank = [&](double percentile) { return values[std::min(values.size() - 1, std::size_t(std::ceil(percentile * values.size())) - 1)]; };
+    summary.p50 = rank(0.5);
+    summary.p99 = rank(0.99);
+    summary.max = values.back();
+    return summary;
+}
+
+std::string jsonString(const std::string& text)
+{
+    std::string quoted = "\"";
+    for(char c : text)
+    {
+        if(c == '"' || c == '\\')
+            quoted += '\\';
+        quoted += c;
+    }
+    return quoted + "\"";
+}
+
+void writeJson(std::ostream& out, const BatchOptions& options, const std::vector<FrameTiming>& timings, double wallMs, const RecorderStats& recording)
+{
+    typedef double (*Field)(const FrameTiming&);
+    const std::vector<std::pair<std::string, Field>> stages = {
+        {"load", [](const FrameTiming& timing) { return timing.loadMs; }},
+        {"filter", [](const FrameTiming& timing) { return timing.filterMs; }},
+        {"segment", [](const FrameTiming& timing) { return timing.segmentMs; }},
+        {"cluster", [](const FrameTiming& timing) { return timing.clusterMs; }},
+        {"total", [](const FrameTiming& timing) { return timing.totalMs(); }}};
+
+    long long clusters = 0;
+    for(const FrameTiming& timing : timings)
+        clusters += timing.clusters;
+
+    out << std::fixed << std::setprecision(3);
+    out << "{\n";
+    out << "  \"source\": " << jsonString(options.dataPath) << ",\n";
+    out << "  \"threads\": " << options.threads << ",\n";
+    out << "  \"pipelined\": " << (options.pipelined ? "true" : "false") << ",\n";
+    out << "  \"frames\": " << timings.size() << ",\n";
+    out << "  \"wall_ms\": " << wallMs << ",\n";
+    out << "  \"frames_per_second\": " << (wallMs > 0 ? 1000.0 * timings.size() / wallMs : 0.0) << ",\n";
+    out << "  \"clusters\": " << clusters << ",\n";
+    out << "  \"mean_clusters_per_frame\": " << (timings.empty() ? 0.0 : double(clusters) / timings.size()) << ",\n";
+    if(!options.recordPath.empty())
+        out << "  \"recording\": {\"directory\": " << jsonString(options.recordPath) << ", \"files\": " << recording.recorded
+            << ", \"dropped\": " << recording.dropped << ", \"failed\": " << recording.failed << ", \"megabytes\": " << recording.bytes / (1024.0 * 1024.0)
+            << ", \"syncs\": " << recording.syncs << ", \"sync_failures\": " << recording.syncFailures << ", \"max_queued\": " << recording.maxQueued << ", \"writer_ms\": " << recording.writeMs << "},\n";
+    out << "  \"stages_ms\": {\n";
+    for(std::size_t stage = 0; stage < stages.size(); ++stage)
+    {
+        std::vector<double> values;
+        for(const FrameTiming& timing : timings)
+            values.push_back(stages[stage].second(timing));
+        const TimingSummary summary = summarize(values);
+        out << "    " << jsonString(stages[stage].first) << ": {\"mean\": " << summary.mean << ", \"p50\": " << summary.p50
+            << ", \"p99\": " << summary.p99 << ", \"max\": " << summary.max << "}" << (stage + 1 < stages.size() ? "," : "") << "\n";
+    }
+    out << "  },\n";
+    // every stage call of the run from the metrics registry, including the ones the
+    // per frame stages above are made of
+    out << "  \"metrics\": ";
+    metrics().snapshot().writeJson(out, "  ");
+    out << ",\n";
+    out << "  \"per_frame\": [\n";
+    for(std::size_t index = 0; index < timings.size(); ++index)
+    {
+        const FrameTiming& timing = timings[index];
+        out << "    {\"frame\": " << index << ", \"file\": " << jsonString(timing.path) << ", \"points\": " << timing.points
+            << ", \"load_ms\": " << timing.loadMs << ", \"filter_ms\": " << timing.filterMs << ", \"segment_ms\": " << timing.segmentMs
+            << ", \"cluster_ms\": " << timing.clusterMs << ", \"total_ms\": " << timing.totalMs() << ", \"clusters\": " << timing.clusters
+            << "}" << (index + 1 < timings.size() ? "," : "") << "\n";
+    }
+    out << "  ]\n";
+    out << "}\n";
+}
+
+// one row per frame, then mean, p50, p99 and max rows in place of the frame number and
+// an fps row with only its own column set
+void writeCsv(std::ostream& out, const std::vector<FrameTiming>& timings, double wallMs)
+{
+    out << std::fixed << std::setprecision(3);
+    out << "frame,file,points,load_ms,filter_ms,segment_ms,cluster_ms,total_ms,clusters,fps\n";
+    for(std::size_t index = 0; index < timings.size(); ++index)
+    {
+        const FrameTiming& timing = timings[index];
+        out << index << "," << timing.path << "," << timing.points << "," << timing.loadMs << "," << timing.filterMs << ","
+            << timing.segmentMs << "," << timing.clusterMs << "," << timing.totalMs() << "," << timing.clusters << ",\n";
+    }
+
+    std::vector<double> loads, filters, segments, clusterings, totals, clusters;
+    for(const FrameTiming& timing : timings)
+    {
+        loads.push_back(timing.loadMs);
+        filters.push_back(timing.filterMs);
+        segments.push_back(timing.segmentMs);
+        clusterings.push_back(timing.clusterMs);
+        totals.push_back(timing.totalMs());
+        clusters.push_back(timing.clusters);
+    }
+    const TimingSummary summaries[] = {summarize(loads), summarize(filters), summarize(segments), summarize(clusterings), summarize(totals), summarize(clusters)};
+    const char* names[] = {"mean", "p50", "p99", "max"};
+    for(int row = 0; row < 4; ++row)
+    {
+        out << names[row] << ",,";
+        for(const TimingSummary& summary : summaries)
+        {
+            const double values[] = {summary.mean, summary.p50, summary.p99, summary.max};
+            out << "," << values[row];
+        }
+        out << ",\n";
+    }
+    out << "fps,,,,,,,,," << (wallMs > 0 ? 1000.0 * timings.size() / wallMs : 0.0) << "\n";
+}
+
+void usage()
+{
+    std::cerr << "usage: batch [pcd directory or archive] [--format json|csv] [--output file] [--threads n] [--pipelined] [--seed n]\n"
+              << "             [--record directory] [--record-compressed] [--record-drop]\n"
+              << "  runs filtering, ground segmentation, clustering and bounding boxes over every frame once\n"
+              << "  --threads n   worker threads inside the stages, 0 uses every hardware thread\n"
+              << "  --pipelined   load and run the stages on their own threads like the viewer, for throughput\n"
+              << "  --seed n      fixed RANSAC seed for repeatable detections\n"
+              << "  --record d    write the filtered, obstacle and ground clouds of every frame to d from a background thread,\n"
+              << "                as binary pcd or with --record-compressed as .pcq; --record-drop skips clouds rather than\n"
+              << "                waiting when the writer falls behind" << std::endl;
+}
+
+bool parseOptions(int argc, char** argv, BatchOptions& options)
+{
+    for(int arg = 1; arg < argc; ++arg)
+    {
+        const bool hasValue = arg + 1 < argc;
+        if(std::strcmp(argv[arg], "--format") == 0 && hasValue)
+            options.format = argv[++arg];
+        else if(std::strcmp(argv[arg], "--output") == 0 && hasValue)
+            options.output = argv[++arg];
+        else if(std::strcmp(argv[arg], "--threads") == 0 && hasValue)
+            options.threads = std::atoi(argv[++arg]);
+        else if(std::strcmp(argv[arg], "--seed") == 0 && hasValue)
+        {
+            options.haveSeed = true;
+            options.seed = unsigned(std::strtoul(argv[++arg], nullptr, 10));
+        }
+        else if(std::strcmp(argv[arg], "--record") == 0 && hasValue)
+            options.recordPath = argv[++arg];
+        else if(std::strcmp(argv[arg], "--pipelined") == 0)
+            options.pipelined = true;
+        else if(std::strcmp(argv[arg], "--record-compressed") == 0)
+            options.recorder.compress = true;
+        else if(std::strcmp(argv[arg], "--record-drop") == 0)
+            options.recorder.policy = RecordPolicy::Drop;
+        else if(argv[arg][0] != '-')
+            options.dataPath = argv[arg];
+        else
+            return false;
+    }
+    return options.format == "json" || options.format == "csv";
+}
+
+int main (int argc, char** argv)
+{
+    BatchOptions options;
+    if(!parseOptions(argc, argv, options))
+    {
+        usage();
+        return 2;
+    }
+
+    // same settings as the viewer
+    ProcessPointClouds<pcl::PointXYZI> pointProcessorI;
+    pointProcessorI.setRansacConfidence(0.99);
+    pointProcessorI.setRansacRefinement(true);
+    pointProcessorI.setNumThreads(options.threads);
+    if(options.haveSeed)
+        pointProcessorI.setRansacSeed(options.seed);
+
+    FrameStream<pcl::PointXYZI> stream;
+    if(!stream.open(options.dataPath))
+    {
+        std::cerr << options.dataPath << " is neither a pcd directory nor a replay archive" << std::endl;
+        return 1;
+    }
+    FrameRecorder<pcl::PointXYZI> recorder;
+    if(!options.recordPath.empty() && !recorder.open(options.recordPath, options.recorder))
+    {
+        std::cerr << "cannot record to " << options.recordPath << std::endl;
+        return 1;
+    }
+    std::vector<FrameTiming> timings;
+    timings.reserve(stream.size());
+    double wallMs = 0;
+    {
+        // stage and load lines are not even formatted, errors still reach std::cerr
+        metrics().setConsole(false);
+
+        // from the thread consuming finished frames, the recorder takes one producer
+        auto record = [&](const BatchFrame& item)
+        {
+            if(!recorder.isOpen())
+                return;
+            const std::string name = boost::filesystem::path(item.frame.path).stem().string();
+            recorder.record(item.frame.filteredCloud, name + "_filtered");
+            recorder.record(item.frame.segmentCloud.first, name + "_obstacles");
+            recorder.record(item.frame.segmentCloud.second, name + "_ground");
+        };
+
+        // every stage timed on the thread that runs it
+        std::size_t streamIndex = 0;
+        auto load = [&](BatchFrame& item)
+        {
+            if(streamIndex == stream.size())
+                return false;
+            item = BatchFrame();
+            item.frame.path = item.timing.path = stream.name(streamIndex);
+            item.frame.restart = streamIndex == 0;
+            auto startTime = std::chrono::steady_clock::now();
+            item.frame.inputCloud = pointProcessorI.loadFrame(stream, streamIndex);
+            item.timing.loadMs = elapsedMs(startTime);
+            item.timing.points = item.frame.inputCloud->points.size();
+            ++streamIndex;
+            stream.prefetch(streamIndex);
+            return true;
+        };
+        auto filter = [&](BatchFrame& item)
+        {
+            auto startTime = std::chrono::steady_clock::now();
+            filterStage(pointProcessorI, item.frame);
+            item.timing.filterMs = elapsedMs(startTime);
+        };
+        auto segment = [&](BatchFrame& item)
+        {
+            auto startTime = std::chrono::steady_clock::now();
+            segmentStage(pointProcessorI, item.frame);
+            item.timing.segmentMs = elapsedMs(startTime);
+        };
+        auto cluster = [&](BatchFrame& item)
+        {
+            auto startTime = std::chrono::steady_clock::now();
+            clusterStage(pointProcessorI, item.frame);
+            item.timing.clusterMs = elapsedMs(startTime);
+            item.timing.clusters = item.frame.cloudClusters.size();
+        };
+
+        auto startTime = std::chrono::steady_clock::now();
+        BatchFrame item;
+        if(options.pipelined)
+        {
+            Pipeline<BatchFrame> pipeline(load, {filter, segment, cluster}, 2);
+            while(pipeline.pop(item))
+            {
+                record(item);
+                timings.push_back(item.timing);
+            }
+        }
+        else
+        {
+            while(load(item))
+            {
+                filter(item);
+                segment(item);
+                cluster(item);
+                record(item);
+                timings.push_back(item.timing);
+            }
+        }
+        wallMs = elapsedMs(startTime);
+    }
+    // the remaining queue is written and synced outside the timed run
+    recorder.close();
+
+    std::ofstream file;
+    if(!options.output.empty())
+    {
+        file.open(options.output);
+        if(!file)
+        {
+            std::cerr << "cannot write " << options.output << std::endl;
+            return 1;
+        }
+    }
+    std::ostream& out = options.output.empty() ? std::cout : file;
+    if(options.format == "csv")
+        writeCsv(out, timings, wallMs);
+    else
+        writeJson(out, options, timings, wallMs, recorder.stats());
+
+    std::cerr << timings.size() << " frames in " << wallMs / 1000.0 << " seconds, " << (wallMs > 0 ? 1000.0 * timings.size() / wallMs : 0.0) << " frames per second" << std::endl;
+    if(!options.recordPath.empty())
+    {
+        const RecorderStats& recording = recorder.stats();
+        std::cerr << "recorded " << recording.recorded << " clouds, " << recording.bytes / (1024.0 * 1024.0) << " MB to " << options.recordPath
+                  << ", " << recording.dropped << " dropped, " << recording.failed << " failed, " << recording.syncs << " syncs, " << recording.syncFailures << " failed syncs" << std::endl;
+    }
+    return 0;
+}
@@ -0,0 +1,589 @@
+// Micro-benchmarks of every ProcessPointClouds stage and the quiz algorithms on recorded
+// frames and synthetic clouds of growing size, printed in a fixed order to diff between commits
+
+#include "processPointClouds.h"
+// using templates for processPointClouds so also include .cpp to help linker
+#include "processPointClouds.cpp"
+#include "search/flatKdTree.h"
+#include "clustering/euclideanClusters.h"
+#include "quiz/ransac/ransac.h"
+#include <iomanip>
+#include <algorithm>
+#include <functional>
+#include <cstring>
+#include <sstream>
+#include <array>
+
+typedef pcl::PointCloud<pcl::PointXYZI> Cloud;
+
+struct BenchmarkOptions
+{
+    std::string dataRoot = "../src/sensors/data/pcd";
+    int warmup = 2;
+    int repetitions = 10;
+    // every benchmark runs once per thread count, for scaling runs like --threads 1,2,4,8
+    std::vector<int> threadCounts = {1};
+    std::string format = "text";
+    // only benchmarks whose name contains this
+    std::string filter;
+};
+
+// A cloud the stages run on, with the stage inputs derived from it the way the cityBlock
+// chain derives them (obstacleStages.h). Recorded frames are voxel filtered first;
+// synthetic scenes are not, so every later stage sees their growing size too.
+struct BenchmarkInput
+{
+    std::string name;
+    // voxel size of the filter producing the segmentation input, 0 segments the raw cloud
+    float filterRes = 0.2f;
+    float clusterTolerance = 0.4f;
+    int minClusterSize = 10;
+    int maxClusterSize = 600;
+    Cloud::Ptr raw;
+    Cloud::Ptr filtered;
+    Cloud::Ptr obstacles;
+    std::vector<Cloud::Ptr> clusters;
+};
+
+struct BenchmarkResult
+{
+    std::string benchmark;
+    std::string input;
+    int threads;
+    std::size_t points;
+    double medianMs;
+    double minMs;
+
+    double pointsPerSecond() const { return medianMs > 0 ? points / (medianMs / 1000.0) : 0.0; }
+};
+
+// results stored here cannot be optimised away
+volatile std::size_t benchmarkSink = 0;
+
+// Runs function warmup times untimed, then repetitions times timed; the median is what
+// gets compared between commits, the minimum shows how noisy the run was
+BenchmarkResult measure(const BenchmarkOptions& options, const std::string& benchmark, const BenchmarkInput& input, int threads, std::size_t points, const std::function<std::size_t()>& function)
+{
+    for (int run = 0; run < options.warmup; ++run)
+        benchmarkSink = benchmarkSink + function();
+    std::vector<double> times;
+    for (int run = 0; run < options.repetitions; ++run)
+    {
+        auto startTime = std::chrono::steady_clock::now();
+        benchmarkSink = benchmarkSink + function();
+        times.push_back(std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - startTime).count());
+    }
+    std::sort(times.begin(), times.end());
+    BenchmarkResult result = {benchmark, input.name, threads, points, times[times.size() / 2], times.front()};
+    return result;
+}
+
+// Road surface with sensor noise and rows of car sized boxes on it, in the region the
+// cityBlock filter keeps; the same seed always gives the same cloud
+Cloud::Ptr syntheticScene(std::size_t numPoints, unsigned seed)
+{
+    std::mt19937 generator(seed);
+    std::uniform_real_distribution<float> unit(0.f, 1.f);
+    std::normal_distribution<float> noise(0.f, 0.02f);
+
+    Cloud::Ptr cloud(new Cloud);
+    cloud->points.resize(numPoints);
+    const std::size_t groundPoints = numPoints * 7 / 10;
+    for (std::size_t index = 0; index < numPoints; ++index)
+    {
+        pcl::PointXYZI& point = cloud->points[index];
+        point.intensity = unit(generator);
+        if (index < groundPoints)
+        {
+            point.x = -10.f + 40.f * unit(generator);
+            point.y = -5.f + 11.f * unit(generator);
+            point.z = -1.7f + noise(generator);
+            continue;
+        }
+        // one of 12 cars, 4 x 2 x 1.5 m, three lanes of four
+        const int car = int(index % 12);
+        const float centerX = -5.f + 9.f * (car % 4);
+        const float centerY = -3.5f + 3.5f * (car / 4);
+        point.x = centerX + 4.f * (unit(generator) - 0.5f);
+        point.y = centerY + 2.f * (unit(generator) - 0.5f);
+        point.z = -1.7f + 1.5f * unit(generator);
+        // points on the box faces only, like a lidar return
+        const int face = int(6 * unit(generator));
+        if (face == 0) point.x = centerX - 2.f;
+        else if (face == 1) point.x = centerX + 2.f;
+        else if (face == 2) point.y = centerY - 1.f;
+        else if (face == 3) point.y = centerY + 1.f;
+        else point.z = -0.2f;
+        point.x += noise(generator);
+        point.y += noise(generator);
+        point.z += noise(generator);
+    }
+    cloud->width = numPoints;
+    cloud->height = 1;
+    return cloud;
+}
+
+std::size_t totalPoints(const std::vector<Cloud::Ptr>& clouds)
+{
+    std::size_t points = 0;
+    for (const Cloud::Ptr& cloud : clouds)
+        points += cloud->points.size();
+    return points;
+}
+
+// The RANSAC loops as they were before every call site moved onto ransacFit
+// (segmentation/ransac.h), kept as reference rows: the quiz line and plane fits counting
+// over the PCL points, and SegmentPlaneScratch's hypothesis loop over coordinate arrays.
+// The quiz fits build the inlier set like before, the scorer loop returns the best count.
+std::size_t referenceRansacLine(const pcl::PointCloud<pcl::PointXYZ>& cloud, int maxIterations, float distanceTol, int numThreads, unsigned seed)
+{
+    const int numPoints = cloud.points.size();
+    if (numPoints < 2 || maxIterations <= 0)
+        return 0;
+    auto hypothesis = [&](std::mt19937& gen, Eigen::Vector3f& line) -> int
+    {
+        line.setZero();
+        std::uniform_int_distribution<> distrib(0, numPoints - 1);
+        int index1 = distrib(gen);
+        int index2 = distrib(gen);
+        if (index1 == index2)
+            return -1;
+        float x1 = cloud.points[index1].x, y1 = cloud.points[index1].y;
+        float x2 = cloud.points[index2].x, y2 = cloud.points[index2].y;
+        float a = (y1 - y2);
+        float b = (x2 - x1);
+        float norm = sqrt(a*a + b*b);
+        if (norm == 0)
+            return -1;
+        line << a / norm, b / norm, (x1 * y2 - x2 * y1) / norm;
+        int count = 0;
+        for (const pcl::PointXYZ& point : cloud.points)
+            count += fabs(line[0]*point.x + line[1]*point.y + line[2]) <= distanceTol;
+        return count;
+    };
+    auto keep = [](Eigen::Vector3f&, int count) { return count; };
+    Eigen::Vector3f bestLine = Eigen::Vector3f::Zero();
+    int iterations = 0;
+    std::unordered_set<int> inliersResult;
+    if (parallelRansac(maxIterations, 2, numPoints, 0.0, numThreads, seed, hypothesis, keep, bestLine, iterations) == 0)
+        return 0;
+    for (int index = 0; index < numPoints; index++)
+    {
+        const pcl::PointXYZ& point = cloud.points[index];
+        if (fabs(bestLine[0]*point.x + bestLine[1]*point.y + bestLine[2]) <= distanceTol)
+            inliersResult.insert(index);
+    }
+    return inliersResult.size();
+}
+
+std::size_t referenceRansacPlane(const pcl::PointCloud<pcl::PointXYZ>& cloud, int maxIterations, float distanceTol, int numThreads, unsigned seed)
+{
+    const int numPoints = cloud.points.size();
+    if (numPoints < 3 || maxIterations <= 0)
+        return 0;
+    auto hypothesis = [&](std::mt19937& gen, Eigen::Vector4f& plane) -> int
+    {
+        std::uniform_int_distribution<> distrib(0, numPoints - 1);
+        int index1 = distrib(gen);
+        int index2 = distrib(gen);
+        int index3 = distrib(gen);
+        if (index1 == index2 || index1 == index3 || index2 == index3)
+            return -1;
+        const pcl::PointXYZ& p1 = cloud.points[index1];
+        const pcl::PointXYZ& p2 = cloud.points[index2];
+        const pcl::PointXYZ& p3 = cloud.points[index3];
+        float v1x = p2.x - p1.x, v1y = p2.y - p1.y, v1z = p2.z - p1.z;
+        float v2x = p3.x - p1.x, v2y = p3.y - p1.y, v2z = p3.z - p1.z;
+        float a = v1y * v2z - v1z * v2y;
+        float b = v1z * v2x - v1x * v2z;
+        float c = v1x * v2y - v1y * v2x;
+        float norm = sqrt(a*a + b*b + c*c);
+        if (norm == 0)
+            return -1;
+        plane << a / norm, b / norm, c / norm, -( a*p1.x + b*p1.y + c*p1.z ) / norm;
+        int count = 0;
+        for (const pcl::PointXYZ& point : cloud.points)
+            count += fabs(plane[0]*point.x + plane[1]*point.y + plane[2]*point.z + plane[3]) <= distanceTol;
+        return count;
+    };
+    auto keep = [](Eigen::Vector4f&, int count) { return count; };
+    Eigen::Vector4f bestPlane = Eigen::Vector4f::Zero();
+    int iterations = 0;
+    std::unordered_set<int> inliersResult;
+    if (parallelRansac(maxIterations, 3, numPoints, 0.0, numThreads, seed, hypothesis, keep, bestPlane, iterations) == 0)
+        return 0;
+    for (int index = 0; index < numPoints; index++)
+    {
+        const pcl::PointXYZ& point = cloud.points[index];
+        if (fabs(bestPlane[0]*point.x + bestPlane[1]*point.y + bestPlane[2]*point.z + bestPlane[3]) <= distanceTol)
+            inliersResult.insert(index);
+    }
+    return inliersResult.size();
+}
+
+// SegmentPlaneScratch without refinement or early stopping, what ransacFit/Plane times
+std::size_t referencePlaneScorer(const Cloud& cloud, int maxIterations, float distanceThreshold, int numThreads, unsigned seed)
+{
+    const int numPoints = cloud.points.size();
+    if (numPoints < 3 || maxIterations <= 0)
+        return 0;
+    std::vector<float> xs(numPoints), ys(numPoints), zs(numPoints);
+    for (int index = 0; index < numPoints; ++index) {
+        xs[index] = cloud.points[index].x;
+        ys[index] = cloud.points[index].y;
+        zs[index] = cloud.points[index].z;
+    }
+    auto hypothesis = [&](std::mt19937& rng, Eigen::Vector4f& plane) -> int
+    {
+        std::uniform_int_distribution<int> pick(0, numPoints - 1);
+        int index1 = pick(rng);
+        int index2 = pick(rng);
+        int index3 = pick(rng);
+        if (index1 == index2 || index1 == index3 || index2 == index3)
+            return -1;
+        float v1x = xs[index2] - xs[index1], v1y = ys[index2] - ys[index1], v1z = zs[index2] - zs[index1];
+        float v2x = xs[index3] - xs[index1], v2y = ys[index3] - ys[index1], v2z = zs[index3] - zs[index1];
+        float a = v1y * v2z - v1z * v2y;
+        float b = v1z * v2x - v1x * v2z;
+        float c = v1x * v2y - v1y * v2x;
+        float norm = sqrt(a*a + b*b + c*c);
+        if (norm == 0)
+            return -1;
+        plane << a / norm, b / norm, c / norm, 0;
+        plane[3] = -( plane[0]*xs[index1] + plane[1]*ys[index1] + plane[2]*zs[index1] );
+        const float pa = plane[0], pb = plane[1], pc = plane[2], pd = plane[3];
+        int inliers = 0;
+        for (int index = 0; index < numPoints; ++index)
+            inliers += std::fabs(pa*xs[index] + pb*ys[index] + pc*zs[index] + pd) <= distanceThreshold;
+        return inliers;
+    };
+    auto keep = [](Eigen::Vector4f&, int count) { return count; };
+    Eigen::Vector4f bestPlane = Eigen::Vector4f::Zero();
+    int iterations = 0;
+    return std::max(0, parallelRansac(maxIterations, 3, numPoints, 0.0, numThreads, seed, hypothesis, keep, bestPlane, iterations));
+}
+
+void runBenchmarks(const BenchmarkOptions& options, ProcessPointClouds<pcl::PointXYZI>& pointProcessor, const BenchmarkInput& input, int threads, std::vector<BenchmarkResult>& results)
+{
+    const Eigen::Vector4f minPoint(-10, -5, -5, 1), maxPoint(30, 6, 5, 1);
+    auto run = [&](const std::string& benchmark, std::size_t points, const std::function<std::size_t()>& function)
+    {
+        if (benchmark.find(options.filter) == std::string::npos)
+            return;
+        results.push_back(measure(options, benchmark, input, threads, points, function));
+    };
+
+    const std::size_t rawPoints = input.raw->points.size();
+    const std::size_t filteredPoints = input.filtered->points.size();
+    const std::size_t obstaclePoints = input.obstacles->points.size();
+    const std::size_t clusteredPoints = totalPoints(input.clusters);
+
+    run("FilterCloud/PCL", rawPoints, [&] { return pointProcessor.FilterCloud(input.raw, 0.2f, minPoint, maxPoint, FilterMethod::PCL)->points.size(); });
+    run("FilterCloud/Fused", rawPoints, [&] { return pointProcessor.FilterCloud(input.raw, 0.2f, minPoint, maxPoint, FilterMethod::Fused)->points.size(); });
+    run("FilterCloud/Parallel", rawPoints, [&] { return pointProcessor.FilterCloud(input.raw, 0.2f, minPoint, maxPoint, FilterMethod::Parallel)->points.size(); });
+
+    run("SegmentPlane", filteredPoints, [&] { return pointProcessor.SegmentPlane(input.filtered, 300, 0.2).first->points.size(); });
+    run("SegmentPlaneScratch", filteredPoints, [&] { return pointProcessor.SegmentPlaneScratch(input.filtered, 300, 0.2).first->points.size(); });
+    // the plane is carried over from a primed call, as on every frame of a sequence that
+    // keeps its ground; frames that fall back to a full RANSAC cost SegmentPlaneScratch
+    if (std::string("SegmentPlaneTracked").find(options.filter) != std::string::npos)
+    {
+        pointProcessor.resetPlaneTracking();
+        pointProcessor.SegmentPlaneTracked(input.filtered, 300, 0.2);
+    }
+    run("SegmentPlaneTracked", filteredPoints, [&] { return pointProcessor.SegmentPlaneTracked(input.filtered, 300, 0.2).first->points.size(); });
+    run("SegmentGroundPolar", filteredPoints, [&] { return pointProcessor.SegmentGroundPolar(input.filtered, 0.2).first->points.size(); });
+
+    // the raw scan into the image ClusterMethod::RangeImage uses by default
+    const RangeImageGeometry geometry(32, 512, float(-25 * M_PI / 180), float(6 * M_PI / 180));
+    run("ProjectRangeImage", rawPoints, [&] { return rawPoints - pointProcessor.ProjectRangeImage(input.raw, geometry).droppedPoints; });
+
+    run("Clustering/PCL", obstaclePoints, [&] { return pointProcessor.Clustering(input.obstacles, input.clusterTolerance, input.minClusterSize, input.maxClusterSize, ClusterMethod::PCL).size(); });
+    run("Clustering/KdTree", obstaclePoints, [&] { return pointProcessor.Clustering(input.obstacles, input.clusterTolerance, input.minClusterSize, input.maxClusterSize, ClusterMethod::KdTree).size(); });
+    run("Clustering/VoxelHash", obstaclePoints, [&] { return pointProcessor.Clustering(input.obstacles, input.clusterTolerance, input.minClusterSize, input.maxClusterSize, ClusterMethod::VoxelHash).size(); });
+    run("Clustering/ParallelVoxelHash", obstaclePoints, [&] { return pointProcessor.Clustering(input.obstacles, input.clusterTolerance, input.minClusterSize, input.maxClusterSize, ClusterMethod::ParallelVoxelHash).size(); });
+    run("Clustering/RangeImage", obstaclePoints, [&] { return pointProcessor.Clustering(input.obstacles, input.clusterTolerance, input.minClusterSize, input.maxClusterSize, ClusterMethod::RangeImage).size(); });
+
+    run("BoundingBox", clusteredPoints, [&]
+    {
+        std::size_t boxes = 0;
+        for (const Cloud::Ptr& cluster : input.clusters)
+            boxes += pointProcessor.BoundingBox(cluster).x_max > -std::numeric_limits<float>::max();
+        return boxes;
+    });
+    run("BoundingBoxPCA", clusteredPoints, [&]
+    {
+        std::size_t boxes = 0;
+        for (const Cloud::Ptr& cluster : input.clusters)
+            boxes += pointProcessor.BoundingBoxPCA(cluster).cube_length >= 0;
+        return boxes;
+    });
+    run("BoundingBoxFootprint", clusteredPoints, [&]
+    {
+        std::size_t boxes = 0;
+        for (const Cloud::Ptr& cluster : input.clusters)
+            boxes += pointProcessor.BoundingBoxFootprint(cluster).cube_length >= 0;
+        return boxes;
+    });
+    run("BoundingBoxFootprint/MinArea", clusteredPoints, [&]
+    {
+        std::size_t boxes = 0;
+        for (const Cloud::Ptr& cluster : input.clusters)
+            boxes += pointProcessor.BoundingBoxFootprint(cluster, FootprintFit::MinArea).cube_length >= 0;
+        return boxes;
+    });
+    run("BoundingBoxes", clusteredPoints, [&] { return pointProcessor.BoundingBoxes(input.clusters).size(); });
+
+    // the quiz KdTree is FlatKdTree (quiz/cluster/kdtree.h), built in bulk over a cloud,
+    // next to the FLANN backed pcl::search::KdTree the PCL clustering searches with
+    run("quiz/KdTree/build", filteredPoints, [&]
+    {
+        FlatKdTree<pcl::PointXYZI> tree;
+        tree.setInputCloud(input.filtered);
+        return std::size_t(tree.getNodes().size());
+    });
+    run("PCL/KdTree/build", filteredPoints, [&]
+    {
+        pcl::search::KdTree<pcl::PointXYZI> tree;
+        tree.setInputCloud(input.filtered);
+        return std::size_t(1);
+    });
+    FlatKdTree<pcl::PointXYZI> tree;
+    tree.setInputCloud(input.filtered);
+    run("quiz/KdTree/search", filteredPoints, [&]
+    {
+        std::size_t found = 0;
+        std::vector<int> nearby;
+        for (const pcl::PointXYZI& point : input.filtered->points)
+        {
+            nearby.clear();
+            found += tree.radiusSearch(point, 0.5f, nearby);
+        }
+        return found;
+    });
+    pcl::search::KdTree<pcl::PointXYZI> pclTree;
+    pclTree.setInputCloud(input.filtered);
+    run("PCL/KdTree/search", filteredPoints, [&]
+    {
+        std::size_t found = 0;
+        std::vector<int> nearby;
+        std::vector<float> distances;
+        for (const pcl::PointXYZI& point : input.filtered->points)
+            found += pclTree.radiusSearch(point, 0.5, nearby, distances);
+        return found;
+    });
+    // euclideanCluster of quiz/cluster/cluster.cpp forwards to euclideanClusters
+    run("quiz/euclideanCluster", obstaclePoints, [&]
+    {
+        FlatKdTree<pcl::PointXYZI> obstacleTree;
+        obstacleTree.setInputCloud(input.obstacles);
+        return euclideanClusters(*input.obstacles, obstacleTree, input.clusterTolerance).size();
+    });
+    // RansacPlane of quiz/ransac/ransac.h takes PointXYZ clouds, copied outside the timing
+    pcl::PointCloud<pcl::PointXYZ>::Ptr filteredXYZ(new pcl::PointCloud<pcl::PointXYZ>);
+    for (const pcl::PointXYZI& point : input.filtered->points)
+    {
+        pcl::PointXYZ copy;
+        copy.x = point.x;
+        copy.y = point.y;
+        copy.z = point.z;
+        filteredXYZ->points.push_back(copy);
+    }
+    filteredXYZ->width = filteredXYZ->points.size();
+    filteredXYZ->height = 1;
+    run("quiz/RansacLine", filteredPoints, [&] { return RansacLine(filteredXYZ, 100, 0.2f, threads, 1).size(); });
+    run("reference/RansacLine", filteredPoints, [&] { return referenceRansacLine(*filteredXYZ, 100, 0.2f, threads, 1); });
+    run("quiz/RansacPlane", filteredPoints, [&] { return RansacPlane(filteredXYZ, 100, 0.2f, threads, 1).size(); });
+    run("reference/RansacPlane", filteredPoints, [&] { return referenceRansacPlane(*filteredXYZ, 100, 0.2f, threads, 1); });
+    // SegmentPlaneScratch's fit with refinement and early stopping off
+    run("ransacFit/Plane", filteredPoints, [&]
+    {
+        PointArrays points(*input.filtered);
+        Eigen::Vector4f plane;
+        int iterations = 0;
+        return std::size_t(std::max(0, ransacFit(points, PlaneModel(), 0.2f, 100, 0.0, false, threads, 1, plane, iterations)));
+    });
+    run("reference/PlaneScorer", filteredPoints, [&] { return referencePlaneScorer(*input.filtered, 100, 0.2f, threads, 1); });
+}
+
+// Clusters as sorted lists of their points' coordinates, sorted, so two methods compare
+// equal exactly when they partition the cloud the same way, whatever their cluster order
+std::vector<std::vector<std::array<float, 3>>> partition(const std::vector<Cloud::Ptr>& clusters)
+{
+    std::vector<std::vector<std::array<float, 3>>> sets;
+    for (const Cloud::Ptr& cluster : clusters)
+    {
+        std::vector<std::array<float, 3>> points;
+        for (const pcl::PointXYZI& point : cluster->points)
+            points.push_back({point.x, point.y, point.z});
+        std::sort(points.begin(), points.end());
+        sets.push_back(points);
+    }
+    std::sort(sets.begin(), sets.end());
+    return sets;
+}
+
+// Every Euclidean clustering method must give the partition of the PCL method on the
+// obstacle cloud; false and a message for each one that does not
+bool checkPartitions(ProcessPointClouds<pcl::PointXYZI>& pointProcessor, const BenchmarkInput& input, int threads)
+{
+    auto cluster = [&](ClusterMethod method)
+    {
+        return partition(pointProcessor.Clustering(input.obstacles, input.clusterTolerance, input.minClusterSize, input.maxClusterSize, method));
+    };
+    const std::vector<std::vector<std::array<float, 3>>> expected = cluster(ClusterMethod::PCL);
+    bool matches = true;
+    const std::pair<ClusterMethod, const char*> methods[] = {{ClusterMethod::KdTree, "KdTree"}, {ClusterMethod::VoxelHash, "VoxelHash"}, {ClusterMethod::ParallelVoxelHash, "ParallelVoxelHash"}};
+    for (const std::pair<ClusterMethod, const char*>& method : methods)
+        if (cluster(method.first) != expected)
+        {
+            std::cerr << input.name << ": Clustering/" << method.second << " on " << threads << " threads does not match the Clustering/PCL partition" << std::endl;
+            matches = false;
+        }
+    return matches;
+}
+
+void writeText(std::ostream& out, const BenchmarkOptions& options, const std::vector<BenchmarkResult>& results)
+{
+    out << "warmup " << options.warmup << ", repetitions " << options.repetitions << "\n";
+    out << std::left << std::setw(30) << "benchmark" << std::setw(28) << "input" << std::right << std::setw(8) << "threads" << std::setw(10) << "points"
+        << std::setw(12) << "median ms" << std::setw(12) << "min ms" << std::setw(14) << "Mpoints/s" << "\n";
+    out << std::fixed;
+    for (const BenchmarkResult& result : results)
+        out << std::left << std::setw(30) << result.benchmark << std::setw(28) << result.input << std::right << std::setw(8) << result.threads << std::setw(10) << result.points
+            << std::setprecision(3) << std::setw(12) << result.medianMs << std::setw(12) << result.minMs
+            << std::setprecision(2) << std::setw(14) << result.pointsPerSecond() / 1e6 << "\n";
+}
+
+void writeCsv(std::ostream& out, const std::vector<BenchmarkResult>& results)
+{
+    out << "benchmark,input,threads,points,median_ms,min_ms,points_per_second\n" << std::fixed;
+    for (const BenchmarkResult& result : results)
+        out << result.benchmark << "," << result.input << "," << result.threads << "," << result.points << "," << std::setprecision(4) << result.medianMs << ","
+            << result.minMs << "," << std::setprecision(0) << result.pointsPerSecond() << "\n";
+}
+
+void usage()
+{
+    std::cerr << "usage: benchmark [--data root] [--warmup n] [--repetitions n] [--threads n,...] [--format text|csv] [--filter name]\n"
+              << "  times every stage on the first frames of data_1 and data_2, simpleHighway.pcd and synthetic\n"
+              << "  scenes of 10k, 40k and 160k points; results come in the same order every run\n"
+              << "  --data root   directory holding data_1, data_2 and simpleHighway.pcd\n"
+              << "  --threads l   comma separated thread counts, every benchmark runs at each, 0 uses every hardware thread\n"
+              << "  --filter s    only benchmarks whose name contains s, e.g. Clustering or quiz/" << std::endl;
+}
+
+bool parseOptions(int argc, char** argv, BenchmarkOptions& options)
+{
+    for (int arg = 1; arg < argc; ++arg)
+    {
+        if (arg + 1 >= argc)
+            return false;
+        if (std::strcmp(argv[arg], "--data") == 0)
+            options.dataRoot = argv[++arg];
+        else if (std::strcmp(argv[arg], "--warmup") == 0)
+            options.warmup = std::atoi(argv[++arg]);
+        else if (std::strcmp(argv[arg], "--repetitions") == 0)
+            options.repetitions = std::atoi(argv[++arg]);
+        else if (std::strcmp(argv[arg], "--threads") == 0)
+        {
+            options.threadCounts.clear();
+            std::stringstream list(argv[++arg]);
+            std::string count;
+            while (std::getline(list, count, ','))
+                options.threadCounts.push_back(std::atoi(count.c_str()));
+        }
+        else if (std::strcmp(argv[arg], "--format") == 0)
+            options.format = argv[++arg];
+        else if (std::strcmp(argv[arg], "--filter") == 0)
+            options.filter = argv[++arg];
+        else
+            return false;
+    }
+    for (int threads : options.threadCounts)
+        if (threads < 0)
+            return false;
+    return options.warmup >= 0 && options.repetitions > 0 && !options.threadCounts.empty() && (options.format == "text" || options.format == "csv");
+}
+
+int main (int argc, char** argv)
+{
+    BenchmarkOptions options;
+    if (!parseOptions(argc, argv, options))
+    {
+        usage();
+        return 2;
+    }
+
+    // fixed seed, and the stage inputs below come from one thread, so every run segments
+    // the same planes
+    ProcessPointClouds<pcl::PointXYZI> pointProcessor;
+    pointProcessor.setRansacConfidence(0.99);
+    pointProcessor.setRansacRefinement(true);
+    pointProcessor.setRansacSeed(1);
+
+    std::vector<BenchmarkInput> inputs;
+    for (const std::string sequence : {"data_1", "data_2"})
+    {
+        FrameStream<pcl::PointXYZI> stream;
+        if (!stream.open(options.dataRoot + "/" + sequence) || stream.size() == 0)
+        {
+            std::cerr << "no frames in " << options.dataRoot + "/" + sequence << std::endl;
+            return 1;
+        }
+        BenchmarkInput input;
+        input.name = sequence + "/" + boost::filesystem::path(stream.name(0)).filename().string();
+        input.raw = pointProcessor.loadFrame(stream, 0);
+        inputs.push_back(input);
+    }
+    {
+        // unfiltered and with the cluster settings of simpleHighway() in environment.cpp
+        BenchmarkInput input;
+        input.name = "simpleHighway.pcd";
+        input.filterRes = 0;
+        input.clusterTolerance = 1.0f;
+        input.minClusterSize = 3;
+        input.maxClusterSize = 30;
+        input.raw = pointProcessor.loadPcd(options.dataRoot + "/simpleHighway.pcd");
+        inputs.push_back(input);
+    }
+    for (std::size_t numPoints : {10000, 40000, 160000})
+    {
+        BenchmarkInput input;
+        input.name = "synthetic/" + std::to_string(numPoints / 1000) + "k";
+        input.filterRes = 0;
+        input.maxClusterSize = std::numeric_limits<int>::max();
+        input.raw = syntheticScene(numPoints, 1);
+        inputs.push_back(input);
+    }
+
+    metrics().setConsole(false);
+    std::vector<BenchmarkResult> results;
+    // partitions are checked whenever a clustering benchmark runs
+    bool partitionsMatch = true, checkClusters = false;
+    for (const char* name : {"Clustering/PCL", "Clustering/KdTree", "Clustering/VoxelHash", "Clustering/ParallelVoxelHash"})
+        checkClusters = checkClusters || std::string(name).find(options.filter) != std::string::npos;
+    for (BenchmarkInput& input : inputs)
+    {
+        // stage inputs as cityBlock produces them
+        input.filtered = input.filterRes > 0 ? pointProcessor.FilterCloud(input.raw, input.filterRes, Eigen::Vector4f(-10, -5, -5, 1), Eigen::Vector4f(30, 6, 5, 1), FilterMethod::Fused) : input.raw;
+        input.obstacles = pointProcessor.SegmentPlaneScratch(input.filtered, 300, 0.2).first;
+        input.clusters = pointProcessor.Clustering(input.obstacles, input.clusterTolerance, input.minClusterSize, input.maxClusterSize, ClusterMethod::VoxelHash);
+        std::cerr << input.name << ": " << input.raw->points.size() << " points, " << input.filtered->points.size() << " filtered, "
+                  << input.obstacles->points.size() << " obstacle points, " << input.clusters.size() << " clusters" << std::endl;
+        for (int threads : options.threadCounts)
+        {
+            pointProcessor.setNumThreads(threads);
+            if (checkClusters)
+                partitionsMatch = checkPartitions(pointProcessor, input, threads) && partitionsMatch;
+            runBenchmarks(options, pointProcessor, input, threads, results);
+        }
+        pointProcessor.setNumThreads(1);
+    }
+
+    if (options.format == "csv")
+        writeCsv(std::cout, results);
+    else
+        writeText(std::cout, options, results);
+    return partitionsMatch ? 0 : 1;
+}
@@ -0,0 +1,126 @@
+// Centroid, covariance and bounding boxes of every cluster of a frame in one batch
+
+#ifndef CLUSTERFEATURES_H
+#define CLUSTERFEATURES_H
+
+#include <pcl/common/common.h>
+#include <Eigen/Dense>
+#include <Eigen/StdVector>
+#include <vector>
+#include <limits>
+#include <atomic>
+#include "../render/box.h"
+#include "../common/parallel.h"
+
+struct ClusterFeatures
+{
+	int numPoints;
+	Eigen::Vector3f centroid;
+	// divided by the point count, as pcl::computeCovarianceMatrixNormalized
+	Eigen::Matrix3f covariance;
+	// axis aligned box, as ProcessPointClouds::BoundingBox
+	Box box;
+	// box along the principal axes, as ProcessPointClouds::BoundingBoxPCA
+	BoxQ boxQ;
+
+	EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+};
+
+typedef std::vector<ClusterFeatures, Eigen::aligned_allocator<ClusterFeatures>> ClusterFeatureList;
+
+// All features of one cluster in two passes over its points and without a transformed
+// copy of it. The first pass takes the axis aligned box and the first and second moments,
+// summed in double about the first point so they don't cancel far from the origin. The
+// covariance follows from the moments, then goes through the same eigen decomposition and
+// orientation fix as BoundingBoxPCA. The second pass projects every point onto the
+// principal axes on the fly for the oriented extents. Results agree with BoundingBox
+// exactly and with BoundingBoxPCA to float rounding.
+template<typename PointT>
+void clusterFeatures(const pcl::PointCloud<PointT>& cluster, ClusterFeatures& features)
+{
+	const int numPoints = cluster.points.size();
+	features.numPoints = numPoints;
+	if(numPoints == 0)
+	{
+		features.centroid.setZero();
+		features.covariance.setZero();
+		features.box = Box{0, 0, 0, 0, 0, 0};
+		features.boxQ.bboxTransform.setZero();
+		features.boxQ.bboxQuaternion.setIdentity();
+		features.boxQ.cube_length = features.boxQ.cube_width = features.boxQ.cube_height = 0;
+		return;
+	}
+
+	const float largest = std::numeric_limits<float>::max();
+	Box& box = features.box;
+	box.x_min = box.y_min = box.z_min = largest;
+	box.x_max = box.y_max = box.z_max = -largest;
+	const double rx = cluster.points[0].x, ry = cluster.points[0].y, rz = cluster.points[0].z;
+	double sx = 0, sy = 0, sz = 0, sxx = 0, sxy = 0, sxz = 0, syy = 0, syz = 0, szz = 0;
+	for(const PointT& point : cluster.points)
+	{
+		box.x_min = std::min(box.x_min, point.x); box.x_max = std::max(box.x_max, point.x);
+		box.y_min = std::min(box.y_min, point.y); box.y_max = std::max(box.y_max, point.y);
+		box.z_min = std::min(box.z_min, point.z); box.z_max = std::max(box.z_max, point.z);
+		const double x = point.x - rx, y = point.y - ry, z = point.z - rz;
+		sx += x; sy += y; sz += z;
+		sxx += x*x; sxy += x*y; sxz += x*z;
+		syy += y*y; syz += y*z; szz += z*z;
+	}
+
+	const double n = numPoints;
+	const Eigen::Vector3d mean(sx / n, sy / n, sz / n);
+	Eigen::Matrix3d covariance;
+	covariance << sxx / n - mean[0]*mean[0], sxy / n - mean[0]*mean[1], sxz / n - mean[0]*mean[2],
+				  sxy / n - mean[0]*mean[1], syy / n - mean[1]*mean[1], syz / n - mean[1]*mean[2],
+				  sxz / n - mean[0]*mean[2], syz / n - mean[1]*mean[2], szz / n - mean[2]*mean[2];
+	features.covariance = covariance.cast<float>();
+	features.centroid = (mean + Eigen::Vector3d(rx, ry, rz)).cast<float>();
+
+	Eigen::SelfAdjointEigenSolver<Eigen::Matrix3f> solver(features.covariance, Eigen::ComputeEigenvectors);
+	Eigen::Matrix3f axes = solver.eigenvectors();
+	axes.col(2) = axes.col(0).cross(axes.col(1));
+
+	// the transform BoundingBoxPCA applies to its copy of the cloud
+	const Eigen::Matrix3f rotation = axes.transpose();
+	const Eigen::Vector3f translation = -1.f * (rotation * features.centroid);
+	Eigen::Vector3f minProjected = Eigen::Vector3f::Constant(largest);
+	Eigen::Vector3f maxProjected = Eigen::Vector3f::Constant(-largest);
+	for(const PointT& point : cluster.points)
+	{
+		const Eigen::Vector3f projected = rotation * Eigen::Vector3f(point.x, point.y, point.z) + translation;
+		minProjected = minProjected.cwiseMin(projected);
+		maxProjected = maxProjected.cwiseMax(projected);
+	}
+
+	const Eigen::Vector3f meanDiagonal = 0.5f * (maxProjected + minProjected);
+	features.boxQ.bboxQuaternion = Eigen::Quaternionf(axes);
+	features.boxQ.bboxTransform = axes * meanDiagonal + features.centroid;
+	features.boxQ.cube_length = maxProjected[0] - minProjected[0];
+	features.boxQ.cube_width = maxProjected[1] - minProjected[1];
+	features.boxQ.cube_height = maxProjected[2] - minProjected[2];
+}
+
+// clusterFeatures of every cluster, the clusters handed out one at a time to numThreads
+// threads so a few large ones don't hold up a fixed chunk. The result is in cluster order
+// and independent of the thread count.
+template<typename PointT>
+void clusterFeaturesBatch(const std::vector<typename pcl::PointCloud<PointT>::Ptr>& clusters, ClusterFeatureList& features, int numThreads = 1)
+{
+	const int numClusters = clusters.size();
+	features.resize(numClusters);
+	numThreads = std::max(1, std::min(resolveThreadCount(numThreads), numClusters));
+
+	std::atomic<int> next(0);
+	auto work = [&](int)
+	{
+		for(int cluster = next++; cluster < numClusters; cluster = next++)
+			clusterFeatures(*clusters[cluster], features[cluster]);
+	};
+	if(numThreads == 1)
+		work(0);
+	else
+		sharedThreadPool().run(numThreads, work);
+}
+
+#endif /* CLUSTERFEATURES_H */
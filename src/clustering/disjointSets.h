@@ -0,0 +1,132 @@
+// Union-find over integer ids
+
+#ifndef DISJOINTSETS_H
+#define DISJOINTSETS_H
+
+#include <vector>
+#include <utility>
+#include <atomic>
+#include <memory>
+
+// Union by size with path halving, near constant time per operation
+struct DisjointSets
+{
+	std::vector<int> parent;
+	std::vector<int> size;
+
+	DisjointSets(int count = 0)
+	{
+		reset(count);
+	}
+
+	void reset(int count)
+	{
+		parent.resize(count);
+		size.assign(count, 1);
+		for(int id = 0; id < count; ++id)
+			parent[id] = id;
+	}
+
+	int find(int id)
+	{
+		while(parent[id] != id)
+		{
+			parent[id] = parent[parent[id]];
+			id = parent[id];
+		}
+		return id;
+	}
+
+	// returns false when both were already in the same set
+	bool unite(int first, int second)
+	{
+		first = find(first);
+		second = find(second);
+		if(first == second)
+			return false;
+		if(size[first] < size[second])
+			std::swap(first, second);
+		parent[second] = first;
+		size[first] += size[second];
+		return true;
+	}
+};
+
+// Lock-free union-find for threads merging at the same time. Roots are always linked
+// under the smaller id with a compare and swap, so parents only ever decrease, every set
+// ends up rooted at its smallest id and the result does not depend on the interleaving.
+// Finds halve paths with relaxed stores.
+struct ConcurrentDisjointSets
+{
+	std::unique_ptr<std::atomic<int>[]> parent;
+
+	ConcurrentDisjointSets(int count = 0)
+	{
+		reset(count);
+	}
+
+	void reset(int count)
+	{
+		parent.reset(new std::atomic<int>[count]);
+		for(int id = 0; id < count; ++id)
+			parent[id].store(id, std::memory_order_relaxed);
+	}
+
+	int find(int id)
+	{
+		while(true)
+		{
+			const int next = parent[id].load(std::memory_order_relaxed);
+			if(next == id)
+				return id;
+			const int grandparent = parent[next].load(std::memory_order_relaxed);
+			// id is no root any more so only finds write its parent, and any ancestor is
+			// a valid parent: a plain store that loses against another find is harmless
+			if(grandparent != next)
+				parent[id].store(grandparent, std::memory_order_relaxed);
+			id = grandparent;
+		}
+	}
+
+	// returns false when both were already in the same set
+	bool unite(int first, int second)
+	{
+		while(true)
+		{
+			first = find(first);
+			second = find(second);
+			if(first == second)
+				return false;
+			if(first < second)
+				std::swap(first, second);
+			// fails if another thread linked first meanwhile, then retry from its new root
+			int expected = first;
+			if(parent[first].compare_exchange_strong(expected, second, std::memory_order_acq_rel))
+				return true;
+		}
+	}
+};
+
+// Clusters from the root of every point (-1 for points left out) and the size of every
+// root's set, in order of their lowest point index, dropping those outside [minSize, maxSize]
+inline std::vector<std::vector<int>> clustersFromRoots(const std::vector<int>& pointRoots, const std::vector<int>& rootSizes, int minSize, int maxSize)
+{
+	std::vector<std::vector<int>> clusters;
+	std::vector<int> rootClusters(rootSizes.size(), -1);
+	for(int index = 0; index < int(pointRoots.size()); ++index)
+	{
+		const int root = pointRoots[index];
+		if(root < 0 || rootSizes[root] < minSize || rootSizes[root] > maxSize)
+			continue;
+		if(rootClusters[root] < 0)
+		{
+			rootClusters[root] = clusters.size();
+			clusters.emplace_back();
+			clusters.back().reserve(rootSizes[root]);
+		}
+		clusters[rootClusters[root]].push_back(index);
+	}
+	return clusters;
+}
+
+#endif /* DISJOINTSETS_H */
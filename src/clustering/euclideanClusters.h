@@ -0,0 +1,91 @@
+// Euclidean clustering over a k-d tree with an explicit worklist instead of recursion
+
+#ifndef EUCLIDEANCLUSTERS_H
+#define EUCLIDEANCLUSTERS_H
+
+#include <pcl/common/common.h>
+#include <vector>
+#include <limits>
+#include "../search/flatKdTree.h"
+
+// Connected components of the graph linking points within tolerance of each other, grown
+// breadth first from the lowest unvisited index. Memory is one visited flag and one
+// worklist slot per point plus a reused neighbour buffer, whatever the cluster sizes.
+// Clusters come out in order of their lowest index, the same partition the recursive
+// quiz proximity() produced. Clusters outside [minSize, maxSize] are dropped.
+template<typename PointT>
+std::vector<std::vector<int>> euclideanClusters(const pcl::PointCloud<PointT>& cloud, const FlatKdTree<PointT>& tree, float tolerance, int minSize = 1, int maxSize = std::numeric_limits<int>::max())
+{
+	std::vector<std::vector<int>> clusters;
+	const int numPoints = cloud.points.size();
+
+	std::vector<bool> processed(numPoints, false);
+	std::vector<int> worklist;
+	worklist.reserve(numPoints);
+	std::vector<int> neighbors;
+
+	for(int seed = 0; seed < numPoints; ++seed)
+	{
+		if(processed[seed])
+			continue;
+
+		// the worklist holds the cluster, points before head are expanded
+		worklist.clear();
+		worklist.push_back(seed);
+		processed[seed] = true;
+		for(std::size_t head = 0; head < worklist.size(); ++head)
+		{
+			tree.radiusSearch(cloud.points[worklist[head]], tolerance, neighbors);
+			for(int neighbor : neighbors)
+			{
+				if(processed[neighbor])
+					continue;
+				processed[neighbor] = true;
+				worklist.push_back(neighbor);
+			}
+		}
+
+		const int size = worklist.size();
+		if(size >= minSize && size <= maxSize)
+			clusters.push_back(worklist);
+	}
+	return clusters;
+}
+
+// Same worklist growth over neighbour lists that were computed up front, for instance
+// by a multi-threaded FlatKdTree::radiusSearchBatch over the whole cloud with the
+// clustering tolerance: only the graph walk remains sequential.
+inline std::vector<std::vector<int>> neighborListClusters(const NeighborLists& neighbors, int minSize = 1, int maxSize = std::numeric_limits<int>::max())
+{
+	std::vector<std::vector<int>> clusters;
+	const int numPoints = neighbors.size();
+
+	std::vector<bool> processed(numPoints, false);
+	std::vector<int> worklist;
+	worklist.reserve(numPoints);
+
+	for(int seed = 0; seed < numPoints; ++seed)
+	{
+		if(processed[seed])
+			continue;
+
+		worklist.clear();
+		worklist.push_back(seed);
+		processed[seed] = true;
+		for(std::size_t head = 0; head < worklist.size(); ++head)
+			for(const int* neighbor = neighbors.begin(worklist[head]); neighbor != neighbors.end(worklist[head]); ++neighbor)
+			{
+				if(processed[*neighbor])
+					continue;
+				processed[*neighbor] = true;
+				worklist.push_back(*neighbor);
+			}
+
+		const int size = worklist.size();
+		if(size >= minSize && size <= maxSize)
+			clusters.push_back(worklist);
+	}
+	return clusters;
+}
+
+#endif /* EUCLIDEANCLUSTERS_H */
@@ -0,0 +1,126 @@
+// Euclidean clustering through (ring, azimuth) adjacency in a range image
+
+#ifndef RANGEIMAGECLUSTERS_H
+#define RANGEIMAGECLUSTERS_H
+
+#include <pcl/common/common.h>
+#include <vector>
+#include <limits>
+#include <algorithm>
+#include <cmath>
+#include "../sensors/rangeImage.h"
+#include "disjointSets.h"
+
+// Clusters a projected scan without any spatial index: every point only looks at the
+// image cells around its own, and joins the points there that lie within tolerance
+// (distance based break). The window is sized from the point's range so that any point
+// within tolerance falls inside it: rows up to tolerance / ((range - tolerance) * ring
+// height) + 1, columns likewise with the planar range, capped at the image size, which
+// gives the same partition as Euclidean clustering. Every point only scans the forward
+// half of its window (later rows, or later columns of its own row), since the partner
+// of a close pair always has the point in its own window too. All points that projected
+// into a cell take part, not just the one the image stores: they are bucketed by cell in
+// row major order with their coordinates, so the scan reads memory in image order. Far
+// points get a window of a few cells, so the work is linear in the point count.
+// Clusters are listed in order of their lowest point index, those outside
+// [minSize, maxSize] are dropped.
+template<typename PointT>
+std::vector<std::vector<int>> rangeImageClusters(const RangeImage<PointT>& image, float tolerance, int minSize = 1, int maxSize = std::numeric_limits<int>::max())
+{
+	const pcl::PointCloud<PointT>& cloud = *image.cloud;
+	const RangeImageGeometry& geometry = image.geometry;
+	const int numPoints = cloud.points.size();
+	const int rows = image.rows(), cols = image.cols();
+	const int numCells = rows * cols;
+	const float tolerance2 = tolerance * tolerance;
+
+	// smallest ring spacing keeps the row window conservative for uneven rings
+	float ringAngle = geometry.ringHeight();
+	for(std::size_t edge = 1; edge < geometry.ringEdges.size(); ++edge)
+		ringAngle = std::min(ringAngle, geometry.ringEdges[edge] - geometry.ringEdges[edge - 1]);
+	const float columnAngle = geometry.columnWidth();
+
+	// points of cell c are order[cellStart[c]] .. order[cellStart[c + 1] - 1]
+	std::vector<int> cellStart(numCells + 1, 0);
+	for(int cell : image.pointCells)
+		if(cell >= 0)
+			++cellStart[cell + 1];
+	for(int cell = 0; cell < numCells; ++cell)
+		cellStart[cell + 1] += cellStart[cell];
+	const int numProjected = cellStart[numCells];
+	std::vector<int> order(numProjected);
+	{
+		std::vector<int> fill(cellStart.begin(), cellStart.end() - 1);
+		for(int index = 0; index < numPoints; ++index)
+			if(image.pointCells[index] >= 0)
+				order[fill[image.pointCells[index]]++] = index;
+	}
+	std::vector<float> xs(numProjected), ys(numProjected), zs(numProjected);
+	for(int position = 0; position < numProjected; ++position)
+	{
+		const PointT& point = cloud.points[order[position]];
+		xs[position] = point.x;
+		ys[position] = point.y;
+		zs[position] = point.z;
+	}
+
+	// union-find over positions in image order
+	DisjointSets sets(numProjected);
+	auto linkRange = [&](int position, int begin, int end)
+	{
+		const float x = xs[position], y = ys[position], z = zs[position];
+		for(int other = begin; other < end; ++other)
+		{
+			const float dx = xs[other] - x, dy = ys[other] - y, dz = zs[other] - z;
+			if(dx*dx + dy*dy + dz*dz <= tolerance2)
+				sets.unite(position, other);
+		}
+	};
+
+	for(int cell = 0; cell < numCells; ++cell)
+	{
+		const int row = cell / cols, col = cell % cols;
+		for(int position = cellStart[cell]; position < cellStart[cell + 1]; ++position)
+		{
+			// azimuth is measured in the xy plane, so columns scale with the planar range
+			const float dx = xs[position] - geometry.origin[0], dy = ys[position] - geometry.origin[1], dz = zs[position] - geometry.origin[2];
+			const float planar2 = dx*dx + dy*dy;
+			const float nearest = std::sqrt(planar2 + dz*dz) - tolerance;
+			const float nearestPlanar = std::sqrt(planar2) - tolerance;
+			const int rowWindow = nearest > 0 ? int(std::min(float(rows), tolerance / (nearest * ringAngle) + 1)) : rows;
+			const int colWindow = nearestPlanar > 0 ? int(std::min(float(cols / 2), tolerance / (nearestPlanar * columnAngle) + 1)) : cols / 2;
+
+			// rest of the own cell and the later columns of the own row
+			linkRange(position, position + 1, cellStart[cell + 1]);
+			for(int dCol = 1; dCol <= colWindow; ++dCol)
+			{
+				const int other = image.cellIndex(row, image.wrapColumn(col + dCol));
+				linkRange(position, cellStart[other], cellStart[other + 1]);
+			}
+			// later rows, narrowing as the elevation gap alone uses up more of the tolerance
+			for(int otherRow = row + 1; otherRow <= std::min(rows - 1, row + rowWindow); ++otherRow)
+			{
+				const float gap = nearest > 0 ? (otherRow - row - 1) * ringAngle * nearest : 0.f;
+				const float remaining = std::sqrt(std::max(0.f, tolerance2 - gap * gap));
+				const int rowColWindow = nearestPlanar > 0 ? std::min(colWindow, int(remaining / (nearestPlanar * columnAngle) + 1)) : colWindow;
+				for(int dCol = -rowColWindow; dCol <= rowColWindow; ++dCol)
+				{
+					const int other = image.cellIndex(otherRow, image.wrapColumn(col + dCol));
+					linkRange(position, cellStart[other], cellStart[other + 1]);
+				}
+			}
+		}
+	}
+
+	std::vector<int> pointRoots(numPoints, -1);
+	std::vector<int> rootSizes(numProjected, 0);
+	for(int position = 0; position < numProjected; ++position)
+	{
+		const int root = sets.find(position);
+		pointRoots[order[position]] = root;
+		++rootSizes[root];
+	}
+	return clustersFromRoots(pointRoots, rootSizes, minSize, maxSize);
+}
+
+#endif /* RANGEIMAGECLUSTERS_H */
@@ -0,0 +1,301 @@
+// Euclidean clustering on a hashed grid of tolerance sized cells
+
+#ifndef VOXELHASHCLUSTERS_H
+#define VOXELHASHCLUSTERS_H
+
+#include <pcl/common/common.h>
+#include <array>
+#include <algorithm>
+#include <vector>
+#include <limits>
+#include <cmath>
+#include "../filters/voxelFilter.h"
+#include "../common/parallel.h"
+#include "disjointSets.h"
+
+// Points bucketed into cubic cells with the edge of the clustering tolerance, so every
+// neighbour of a point lies in its own cell or one of the 26 around it. The build works
+// like ParallelVoxelFilter: cell keys are computed per chunk of points, the (key, point)
+// entries are grouped by the parallel radix sort and cell boundaries are found per chunk,
+// so it runs on numThreads throughout and gives the same grid for any thread count.
+// Cells are stored in key order with their points contiguous and the coordinates copied
+// alongside in the same order; a cell is found by binary search over the sorted keys. A
+// key packs the cell's offset from the lowest cell on each axis into as many bits as the
+// extent needs, at most 21 per axis, beyond that cells alias like voxelKey's.
+template<typename PointT>
+struct VoxelHashGrid
+{
+	float cellSize;
+	// lowest and highest cell and number of key bits on each axis
+	int minCell[3], maxCell[3];
+	int keyBits[3];
+	// key of every cell, ascending
+	std::vector<uint64_t> cellKeys;
+	// integer i, j, k of every cell
+	std::vector<int> cellCoords;
+	// points of cell c are order[cellStart[c]] .. order[cellStart[c + 1] - 1]
+	std::vector<int> cellStart;
+	std::vector<int> order;
+	std::vector<float> xs, ys, zs;
+	// cell of every point, -1 for non finite points
+	std::vector<int> pointCells;
+
+	void build(const pcl::PointCloud<PointT>& cloud, float setCellSize, int numThreads = 1)
+	{
+		cellSize = setCellSize;
+		const float inverseCell = 1.f / cellSize;
+		const std::size_t numPoints = cloud.points.size();
+		numThreads = std::max(1, resolveThreadCount(numThreads));
+
+		// 1. cell of every point and the extent per chunk
+		std::vector<int> pointCoords(3 * numPoints);
+		std::vector<std::array<int, 6>> chunkExtents(numThreads, std::array<int, 6>{{std::numeric_limits<int>::max(), std::numeric_limits<int>::max(), std::numeric_limits<int>::max(),
+			std::numeric_limits<int>::min(), std::numeric_limits<int>::min(), std::numeric_limits<int>::min()}});
+		std::vector<std::vector<VoxelEntry>> chunkEntries(numThreads);
+		parallelFor(numPoints, numThreads, [&](int threadId, std::size_t begin, std::size_t end)
+		{
+			std::array<int, 6>& extent = chunkExtents[threadId];
+			for(std::size_t index = begin; index < end; ++index)
+			{
+				const PointT& point = cloud.points[index];
+				if(!std::isfinite(point.x) || !std::isfinite(point.y) || !std::isfinite(point.z))
+					continue;
+				int* coords = &pointCoords[3 * index];
+				coords[0] = int(std::floor(point.x * inverseCell));
+				coords[1] = int(std::floor(point.y * inverseCell));
+				coords[2] = int(std::floor(point.z * inverseCell));
+				for(int axis = 0; axis < 3; ++axis)
+				{
+					extent[axis] = std::min(extent[axis], coords[axis]);
+					extent[axis + 3] = std::max(extent[axis + 3], coords[axis]);
+				}
+			}
+		});
+		for(int axis = 0; axis < 3; ++axis)
+		{
+			minCell[axis] = std::numeric_limits<int>::max();
+			maxCell[axis] = std::numeric_limits<int>::min();
+			for(const std::array<int, 6>& extent : chunkExtents)
+			{
+				minCell[axis] = std::min(minCell[axis], extent[axis]);
+				maxCell[axis] = std::max(maxCell[axis], extent[axis + 3]);
+			}
+			keyBits[axis] = 0;
+			const int64_t span = int64_t(maxCell[axis]) - minCell[axis];
+			while(keyBits[axis] < voxelKeyBits && (span >> keyBits[axis]) > 0)
+				++keyBits[axis];
+		}
+
+		// 2. (key, point) entries in chunk order, grouped by the stable radix sort
+		parallelFor(numPoints, numThreads, [&](int threadId, std::size_t begin, std::size_t end)
+		{
+			std::vector<VoxelEntry>& local = chunkEntries[threadId];
+			local.clear();
+			local.reserve(end - begin);
+			for(std::size_t index = begin; index < end; ++index)
+			{
+				const PointT& point = cloud.points[index];
+				if(!std::isfinite(point.x) || !std::isfinite(point.y) || !std::isfinite(point.z))
+					continue;
+				const int* coords = &pointCoords[3 * index];
+				local.push_back(VoxelEntry{key(coords[0], coords[1], coords[2]), int(index)});
+			}
+		});
+		std::vector<VoxelEntry> entries, sortBuffer;
+		for(const std::vector<VoxelEntry>& local : chunkEntries)
+			entries.insert(entries.end(), local.begin(), local.end());
+		radixSortEntries(entries, sortBuffer, keyBits[0] + keyBits[1] + keyBits[2], numThreads);
+
+		// 3. cells start where the key changes, numbered through per chunk counts
+		const std::size_t numEntries = entries.size();
+		std::vector<int> chunkCells(numThreads + 1, 0);
+		parallelFor(numEntries, numThreads, [&](int threadId, std::size_t begin, std::size_t end)
+		{
+			int cells = 0;
+			for(std::size_t position = begin; position < end; ++position)
+				cells += position == 0 || entries[position].key != entries[position - 1].key;
+			chunkCells[threadId + 1] = cells;
+		});
+		for(int threadId = 0; threadId < numThreads; ++threadId)
+			chunkCells[threadId + 1] += chunkCells[threadId];
+		const int cells = chunkCells[numThreads];
+
+		cellKeys.resize(cells);
+		cellCoords.resize(3 * std::size_t(cells));
+		cellStart.resize(cells + 1);
+		cellStart[cells] = numEntries;
+		order.resize(numEntries);
+		xs.resize(numEntries);
+		ys.resize(numEntries);
+		zs.resize(numEntries);
+		pointCells.assign(numPoints, -1);
+		parallelFor(numEntries, numThreads, [&](int threadId, std::size_t begin, std::size_t end)
+		{
+			int cell = chunkCells[threadId] - 1;
+			for(std::size_t position = begin; position < end; ++position)
+			{
+				const VoxelEntry& entry = entries[position];
+				if(position == 0 || entry.key != entries[position - 1].key)
+				{
+					++cell;
+					cellKeys[cell] = entry.key;
+					cellStart[cell] = position;
+					std::copy(&pointCoords[3 * std::size_t(entry.index)], &pointCoords[3 * std::size_t(entry.index)] + 3, &cellCoords[3 * std::size_t(cell)]);
+				}
+				const PointT& point = cloud.points[entry.index];
+				order[position] = entry.index;
+				pointCells[entry.index] = cell;
+				xs[position] = point.x;
+				ys[position] = point.y;
+				zs[position] = point.z;
+			}
+		});
+	}
+
+	// packed offsets of cell (i, j, k) from minCell, x in the highest bits so the cells of
+	// an x column are contiguous
+	uint64_t key(int64_t i, int64_t j, int64_t k) const
+	{
+		const uint64_t x = uint64_t(i - minCell[0]) & voxelKeyMask;
+		const uint64_t y = uint64_t(j - minCell[1]) & voxelKeyMask;
+		const uint64_t z = uint64_t(k - minCell[2]) & voxelKeyMask;
+		return (x << (keyBits[1] + keyBits[2])) | (y << keyBits[2]) | z;
+	}
+
+	int numCells() const { return cellCoords.size() / 3; }
+
+	// id of the cell at (i, j, k), -1 when it holds no points
+	int findCell(int i, int j, int k) const
+	{
+		const int coords[3] = {i, j, k};
+		for(int axis = 0; axis < 3; ++axis)
+			if(coords[axis] < minCell[axis] || coords[axis] > maxCell[axis])
+				return -1;
+		const uint64_t wanted = key(i, j, k);
+		auto found = std::lower_bound(cellKeys.begin(), cellKeys.end(), wanted);
+		return found == cellKeys.end() || *found != wanted ? -1 : int(found - cellKeys.begin());
+	}
+
+	// Calls link(position, otherPosition, otherCell) for every pair of points within
+	// tolerance that lies in cell and itself or one of its 13 forward neighbours, so over
+	// all cells every close pair is seen exactly once. Positions index order / xs / ys / zs.
+	template<typename Link>
+	void forEachClosePair(int cell, float tolerance, Link link) const
+	{
+		const float tolerance2 = tolerance * tolerance;
+		const int i = cellCoords[3 * cell], j = cellCoords[3 * cell + 1], k = cellCoords[3 * cell + 2];
+		for(int dk = 0; dk <= 1; ++dk)
+			for(int dj = (dk == 0 ? 0 : -1); dj <= 1; ++dj)
+				for(int di = (dk == 0 && dj == 0 ? 0 : -1); di <= 1; ++di)
+				{
+					const int other = (di == 0 && dj == 0 && dk == 0) ? cell : findCell(i + di, j + dj, k + dk);
+					if(other < 0)
+						continue;
+					for(int position = cellStart[cell]; position < cellStart[cell + 1]; ++position)
+					{
+						const float x = xs[position], y = ys[position], z = zs[position];
+						const int first = other == cell ? position + 1 : cellStart[other];
+						for(int otherPosition = first; otherPosition < cellStart[other + 1]; ++otherPosition)
+						{
+							const float dx = xs[otherPosition] - x, dy = ys[otherPosition] - y, dz = zs[otherPosition] - z;
+							if(dx*dx + dy*dy + dz*dz <= tolerance2)
+								link(position, otherPosition, other);
+						}
+					}
+				}
+	}
+};
+
+// Connected components of the graph linking points within tolerance, the same partition
+// as Euclidean cluster extraction, in close to linear time: one sorting pass, then only
+// the point pairs of neighbouring cells are tested and merged with union-find. Clusters
+// are listed in order of their lowest point index, those outside [minSize, maxSize] are
+// dropped.
+template<typename PointT>
+std::vector<std::vector<int>> voxelHashClusters(const pcl::PointCloud<PointT>& cloud, float tolerance, int minSize = 1, int maxSize = std::numeric_limits<int>::max())
+{
+	VoxelHashGrid<PointT> grid;
+	grid.build(cloud, tolerance);
+
+	// union-find over grid positions, so neighbouring points are close in memory
+	DisjointSets sets(grid.order.size());
+	for(int cell = 0; cell < grid.numCells(); ++cell)
+		grid.forEachClosePair(cell, tolerance, [&sets](int position, int otherPosition, int) { sets.unite(position, otherPosition); });
+
+	std::vector<int> pointRoots(cloud.points.size(), -1);
+	for(std::size_t position = 0; position < grid.order.size(); ++position)
+		pointRoots[grid.order[position]] = sets.find(position);
+	return clustersFromRoots(pointRoots, sets.size, minSize, maxSize);
+}
+
+// Multi-threaded voxelHashClusters with the identical result. The grid is built on
+// numThreads, then its cells, ordered by x column, are cut into numThreads slabs of whole
+// columns holding about the same number of points. Every slab links its own pairs on one
+// thread, pairs reaching into another slab are kept and merged afterwards by all threads
+// through a ConcurrentDisjointSets. Components are unique and listed by lowest point
+// index, so the thread count never changes the output.
+template<typename PointT>
+std::vector<std::vector<int>> parallelVoxelHashClusters(const pcl::PointCloud<PointT>& cloud, float tolerance, int minSize, int maxSize, int numThreads)
+{
+	numThreads = resolveThreadCount(numThreads);
+
+	VoxelHashGrid<PointT> grid;
+	grid.build(cloud, tolerance, numThreads);
+	const int numCells = grid.numCells();
+	const int numPositions = grid.order.size();
+
+	// slab r is cells [regionStart[r], regionStart[r + 1]), cut at the first column
+	// boundary after an equal share of the points
+	std::vector<int> regionStart(1, 0);
+	for(int region = 1; region < numThreads; ++region)
+	{
+		const int share = int((long long)(region) * numPositions / numThreads);
+		int cell = int(std::upper_bound(grid.cellStart.begin(), grid.cellStart.end() - 1, share) - grid.cellStart.begin()) - 1;
+		cell = std::max(cell, regionStart.back());
+		while(cell < numCells && cell > 0 && grid.cellCoords[3 * cell] == grid.cellCoords[3 * (cell - 1)])
+			++cell;
+		if(cell > regionStart.back() && cell < numCells)
+			regionStart.push_back(cell);
+	}
+	regionStart.push_back(numCells);
+	const int numRegions = regionStart.size() - 1;
+
+	// every slab on its own, its sets only ever touch its own positions
+	ConcurrentDisjointSets sets(numPositions);
+	std::vector<std::vector<std::pair<int, int>>> borderPairs(numRegions);
+	parallelFor(numRegions, numRegions, [&](int, std::size_t begin, std::size_t end)
+	{
+		for(std::size_t region = begin; region < end; ++region)
+			for(int cell = regionStart[region]; cell < regionStart[region + 1]; ++cell)
+				grid.forEachClosePair(cell, tolerance, [&](int position, int otherPosition, int otherCell)
+				{
+					if(otherCell >= regionStart[region] && otherCell < regionStart[region + 1])
+						sets.unite(position, otherPosition);
+					else
+						borderPairs[region].emplace_back(position, otherPosition);
+				});
+	});
+
+	// then the pairs across slab borders, concurrently
+	parallelFor(numRegions, numRegions, [&](int, std::size_t begin, std::size_t end)
+	{
+		for(std::size_t region = begin; region < end; ++region)
+			for(const std::pair<int, int>& pair : borderPairs[region])
+				sets.unite(pair.first, pair.second);
+	});
+
+	std::vector<int> pointRoots(cloud.points.size(), -1);
+	parallelFor(numPositions, numThreads, [&](int, std::size_t begin, std::size_t end)
+	{
+		for(std::size_t position = begin; position < end; ++position)
+			pointRoots[grid.order[position]] = sets.find(position);
+	});
+
+	std::vector<int> rootSizes(numPositions, 0);
+	for(int root : pointRoots)
+		if(root >= 0)
+			++rootSizes[root];
+	return clustersFromRoots(pointRoots, rootSizes, minSize, maxSize);
+}
+
+#endif /* VOXELHASHCLUSTERS_H */
@@ -0,0 +1,137 @@
+// Encodes every frame of a pcd directory or replay archive with the point codec
+// (io/pointCodec.h) and reports compression ratio, coordinate error and decode speed
+// against reading the raw frames, optionally keeping the .pcq files
+
+#include <iostream>
+#include <chrono>
+#include <cstring>
+#include <cstdlib>
+#include "io/frameStream.h"
+#include "io/pointCodec.h"
+
+double elapsedMs(std::chrono::steady_clock::time_point startTime)
+{
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - startTime).count();
+}
+
+void usage()
+{
+    std::cerr << "usage: codec <pcd directory or archive> [--precision metres] [--intensity-bits 8|16] [--output directory]\n"
+              << "  e.g. codec ../src/sensors/data/pcd/data_2 --precision 0.001 --output data_2_pcq" << std::endl;
+}
+
+int main (int argc, char** argv)
+{
+    std::string dataPath, output;
+    PointCodecParams params;
+    for (int arg = 1; arg < argc; ++arg)
+    {
+        const bool hasValue = arg + 1 < argc;
+        if (std::strcmp(argv[arg], "--precision") == 0 && hasValue)
+            params.precision = std::atof(argv[++arg]);
+        else if (std::strcmp(argv[arg], "--intensity-bits") == 0 && hasValue)
+            params.intensityBits = std::atoi(argv[++arg]);
+        else if (std::strcmp(argv[arg], "--output") == 0 && hasValue)
+            output = argv[++arg];
+        else if (argv[arg][0] != '-' && dataPath.empty())
+            dataPath = argv[arg];
+        else
+        {
+            usage();
+            return 2;
+        }
+    }
+    if (dataPath.empty() || !(params.precision > 0) || (params.intensityBits != 8 && params.intensityBits != 16))
+    {
+        usage();
+        return 2;
+    }
+
+    FrameStream<pcl::PointXYZI> stream;
+    if (!stream.open(dataPath))
+    {
+        std::cerr << dataPath << " is neither a pcd directory nor a replay archive" << std::endl;
+        return 1;
+    }
+    if (!output.empty() && !boost::filesystem::is_directory(output) && !boost::filesystem::create_directories(output))
+    {
+        std::cerr << "cannot create " << output << std::endl;
+        return 1;
+    }
+
+    // each decode is repeated so short frames still time well above the clock resolution
+    const int decodeRepeats = 5;
+    std::size_t totalPoints = 0, rawBytes = 0, encodedBytes = 0;
+    double loadMs = 0, encodeMs = 0, decodeMs = 0;
+    double maxError = 0, maxIntensityError = 0;
+    pcl::PointCloud<pcl::PointXYZI> cloud, decoded;
+    std::vector<unsigned char> encoded;
+    for (std::size_t frame = 0; frame < stream.size(); ++frame)
+    {
+        auto startTime = std::chrono::steady_clock::now();
+        if (!stream.load(frame, cloud))
+        {
+            std::cerr << "skipping unreadable " << stream.name(frame) << std::endl;
+            continue;
+        }
+        loadMs += elapsedMs(startTime);
+
+        startTime = std::chrono::steady_clock::now();
+        if (!encodePoints(cloud, params, encoded))
+        {
+            std::cerr << stream.name(frame) << " does not fit the integer grid at precision " << params.precision << std::endl;
+            return 1;
+        }
+        encodeMs += elapsedMs(startTime);
+
+        startTime = std::chrono::steady_clock::now();
+        for (int repeat = 0; repeat < decodeRepeats; ++repeat)
+            if (!decodePoints(encoded.data(), encoded.size(), decoded))
+            {
+                std::cerr << stream.name(frame) << " does not decode" << std::endl;
+                return 1;
+            }
+        decodeMs += elapsedMs(startTime) / decodeRepeats;
+
+        for (std::size_t index = 0; index < cloud.points.size(); ++index)
+        {
+            const pcl::PointXYZI& point = cloud.points[index];
+            const pcl::PointXYZI& copy = decoded.points[index];
+            if (!std::isfinite(point.x) || !std::isfinite(point.y) || !std::isfinite(point.z))
+                continue;
+            maxError = std::max(maxError, double(std::fabs(point.x - copy.x)));
+            maxError = std::max(maxError, double(std::fabs(point.y - copy.y)));
+            maxError = std::max(maxError, double(std::fabs(point.z - copy.z)));
+            maxIntensityError = std::max(maxIntensityError, double(std::fabs(point.intensity - copy.intensity)));
+        }
+
+        if (!output.empty())
+        {
+            const boost::filesystem::path name = boost::filesystem::path(stream.name(frame)).filename().replace_extension(".pcq");
+            const std::string path = (boost::filesystem::path(output) / name).string();
+            std::ofstream out(path, std::ios::binary | std::ios::trunc);
+            if (!out.write(reinterpret_cast<const char*>(encoded.data()), encoded.size()))
+            {
+                std::cerr << "cannot write " << path << std::endl;
+                return 1;
+            }
+        }
+
+        totalPoints += cloud.points.size();
+        // x, y, z and intensity as floats, what a binary pcd or the archive stores
+        rawBytes += 4 * sizeof(float) * cloud.points.size();
+        encodedBytes += encoded.size();
+    }
+
+    const double frames = stream.size();
+    std::cout << "frames " << stream.size() << ", points " << totalPoints << "\n"
+              << "precision " << params.precision * 1000.0 << " mm, intensity " << params.intensityBits << " bits\n"
+              << "raw " << rawBytes / (1024.0 * 1024.0) << " MB, encoded " << encodedBytes / (1024.0 * 1024.0) << " MB, ratio "
+              << (encodedBytes ? double(rawBytes) / encodedBytes : 0.0) << ", " << (totalPoints ? 8.0 * encodedBytes / totalPoints : 0.0) << " bits per point\n"
+              << "max coordinate error " << maxError * 1000.0 << " mm, max intensity error " << maxIntensityError << "\n"
+              << "encode " << encodeMs / frames << " ms per frame\n"
+              << "decode " << decodeMs / frames << " ms per frame, " << (decodeMs > 0 ? totalPoints / decodeMs / 1000.0 : 0.0) << " million points per second, "
+              << (decodeMs > 0 ? rawBytes / (1024.0 * 1024.0) / (decodeMs / 1000.0) : 0.0) << " MB/s of decoded floats\n"
+              << "raw frame load " << loadMs / frames << " ms per frame from " << (stream.fromArchive() ? "the archive" : "the directory") << std::endl;
+    return 0;
+}
@@ -0,0 +1,112 @@
+// Fixed capacity single producer / single consumer queue without locks
+
+#ifndef BOUNDEDQUEUE_H
+#define BOUNDEDQUEUE_H
+
+#include <atomic>
+#include <thread>
+#include <chrono>
+#include <vector>
+#include <cstddef>
+
+// Ring buffer handing items from exactly one producer thread to exactly one consumer
+// thread. The producer only writes tail and the consumer only writes head, each published
+// with release and read with acquire, so no lock is taken. push() blocks while the queue
+// is full, which holds the producer back to the pace of the consumer. Blocked calls spin
+// briefly, then yield, then sleep in short steps, so an idle stage costs little CPU.
+// close() ends the stream: pushes fail from then on and pops return what is left first.
+template<typename T>
+class BoundedQueue
+{
+public:
+	explicit BoundedQueue(std::size_t capacity)
+		: slots(capacity + 1), head(0), tail(0), closed(false)
+	{}
+
+	std::size_t capacity() const { return slots.size() - 1; }
+
+	// items waiting, exact when called from either end, a snapshot from anywhere else
+	std::size_t size() const
+	{
+		const std::size_t first = head.load(std::memory_order_acquire);
+		const std::size_t last = tail.load(std::memory_order_acquire);
+		return (last + slots.size() - first) % slots.size();
+	}
+
+	// moves item in unless the queue is full
+	bool tryPush(T& item)
+	{
+		const std::size_t last = tail.load(std::memory_order_relaxed);
+		const std::size_t next = (last + 1) % slots.size();
+		if(next == head.load(std::memory_order_acquire))
+			return false;
+		slots[last] = std::move(item);
+		tail.store(next, std::memory_order_release);
+		return true;
+	}
+
+	// moves the oldest item out unless the queue is empty, the slot is reset so it doesn't
+	// keep the item's resources alive
+	bool tryPop(T& item)
+	{
+		const std::size_t first = head.load(std::memory_order_relaxed);
+		if(first == tail.load(std::memory_order_acquire))
+			return false;
+		item = std::move(slots[first]);
+		slots[first] = T();
+		head.store((first + 1) % slots.size(), std::memory_order_release);
+		return true;
+	}
+
+	// waits for room, false if the queue was closed first
+	bool push(T& item)
+	{
+		for(int attempt = 0; !closed.load(std::memory_order_acquire); ++attempt)
+		{
+			if(tryPush(item))
+				return true;
+			backOff(attempt);
+		}
+		return false;
+	}
+
+	// waits for an item, false once the queue is closed and drained
+	bool pop(T& item)
+	{
+		for(int attempt = 0; ; ++attempt)
+		{
+			if(tryPop(item))
+				return true;
+			// anything pushed before close() is visible once closed is
+			if(closed.load(std::memory_order_acquire))
+				return tryPop(item);
+			backOff(attempt);
+		}
+	}
+
+	void close() { closed.store(true, std::memory_order_release); }
+
+	bool isClosed() const { return closed.load(std::memory_order_acquire); }
+
+private:
+	static void backOff(int attempt)
+	{
+		if(attempt < 64)
+			return;
+		if(attempt < 128)
+			std::this_thread::yield();
+		else
+			std::this_thread::sleep_for(std::chrono::microseconds(200));
+	}
+
+	std::vector<T> slots;
+	// padding keeps the two indices, written by different threads, off one cache line
+	// (alignas would need C++17 to be honoured by new)
+	std::atomic<std::size_t> head;
+	char headPadding[64];
+	std::atomic<std::size_t> tail;
+	char tailPadding[64];
+	std::atomic<bool> closed;
+};
+
+#endif /* BOUNDEDQUEUE_H */
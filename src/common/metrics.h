@@ -0,0 +1,442 @@
+// Process wide registry of stage latencies and counters, recorded per thread without locks
+
+#ifndef METRICS_H
+#define METRICS_H
+
+#include <atomic>
+#include <mutex>
+#include <memory>
+#include <vector>
+#include <string>
+#include <iostream>
+#include <iomanip>
+#include <chrono>
+#include <algorithm>
+#include <limits>
+#include <cmath>
+#include <cstdint>
+#include <cstddef>
+
+enum class MetricUnit
+{
+	Nanoseconds,
+	Count
+};
+
+// Log linear buckets like an HDR histogram: values below 32 have a bucket each, above that
+// every power of two is split into 32 buckets, so a reported percentile is within about
+// 1.6% of the recorded value. Values from 2^47 (39 hours in nanoseconds) share the last
+// bucket. Plain counts, used for snapshots; threads record into MetricShard.
+class MetricHistogram
+{
+public:
+	static const int subBits = 5;
+	static const int subCount = 1 << subBits;
+	static const int maxExponent = 47;
+	static const int numBuckets = (maxExponent - subBits + 2) * subCount;
+
+	MetricHistogram() : buckets(numBuckets, 0), count(0), sum(0), min(std::numeric_limits<uint64_t>::max()), max(0) {}
+
+	static int bucket(uint64_t value)
+	{
+		if(value < uint64_t(subCount))
+			return int(value);
+#ifdef __GNUC__
+		const int exponent = 63 - __builtin_clzll(value);
+#else
+		int exponent = subBits;
+		while(exponent <= maxExponent && value >> (exponent + 1))
+			++exponent;
+#endif
+		if(exponent > maxExponent)
+			return numBuckets - 1;
+		return (exponent - subBits + 1) * subCount + int(value >> (exponent - subBits)) - subCount;
+	}
+
+	// smallest value falling into a bucket
+	static uint64_t bucketLow(int index)
+	{
+		if(index < subCount)
+			return index;
+		const int exponent = index / subCount + subBits - 1;
+		return uint64_t(subCount + index % subCount) << (exponent - subBits);
+	}
+
+	static uint64_t bucketWidth(int index)
+	{
+		return index < subCount ? 1 : uint64_t(1) << (index / subCount - 1);
+	}
+
+	void record(uint64_t value)
+	{
+		++buckets[bucket(value)];
+		++count;
+		sum += value;
+		min = std::min(min, value);
+		max = std::max(max, value);
+	}
+
+	void merge(const MetricHistogram& other)
+	{
+		for(int index = 0; index < numBuckets; ++index)
+			buckets[index] += other.buckets[index];
+		count += other.count;
+		sum += other.sum;
+		min = std::min(min, other.min);
+		max = std::max(max, other.max);
+	}
+
+	// leaves what was recorded after earlier, a snapshot of the same metric; min and max
+	// come from the remaining buckets
+	void subtract(const MetricHistogram& earlier)
+	{
+		for(int index = 0; index < numBuckets; ++index)
+			buckets[index] -= earlier.buckets[index];
+		count -= earlier.count;
+		sum -= earlier.sum;
+		if(count == 0)
+		{
+			min = std::numeric_limits<uint64_t>::max();
+			max = 0;
+			return;
+		}
+		// a snapshot taken during a record can count a value its bucket doesn't show yet
+		int first = 0, last = numBuckets - 1;
+		while(first < numBuckets && buckets[first] == 0)
+			++first;
+		while(last > first && buckets[last] == 0)
+			--last;
+		if(first == numBuckets)
+			return;
+		min = std::max(min, bucketLow(first));
+		max = std::min(max, bucketLow(last) + bucketWidth(last) - 1);
+	}
+
+	// value at quantile in [0, 1], the middle of its bucket clamped to [min, max]
+	double percentile(double quantile) const
+	{
+		if(count == 0)
+			return 0;
+		const uint64_t rank = std::max<uint64_t>(1, uint64_t(std::ceil(quantile * count)));
+		uint64_t seen = 0;
+		for(int index = 0; index < numBuckets; ++index)
+		{
+			seen += buckets[index];
+			if(seen >= rank)
+			{
+				const double middle = bucketLow(index) + (bucketWidth(index) - 1) / 2.0;
+				return std::min(double(max), std::max(double(min), middle));
+			}
+		}
+		return double(max);
+	}
+
+	double mean() const { return count ? double(sum) / count : 0.0; }
+
+	std::vector<uint64_t> buckets;
+	uint64_t count;
+	uint64_t sum;
+	uint64_t min;
+	uint64_t max;
+};
+
+// One thread's histograms. Only the owning thread writes, with relaxed loads and stores
+// rather than read-modify-writes, and snapshot readers load the same atomics, so
+// recording never waits and never races. Histograms are allocated when a metric is first
+// recorded on the thread.
+class MetricShard
+{
+public:
+	struct Histogram
+	{
+		std::atomic<uint64_t> buckets[MetricHistogram::numBuckets];
+		std::atomic<uint64_t> count;
+		std::atomic<uint64_t> sum;
+		std::atomic<uint64_t> min;
+		std::atomic<uint64_t> max;
+
+		Histogram() : count(0), sum(0), min(std::numeric_limits<uint64_t>::max()), max(0)
+		{
+			for(std::atomic<uint64_t>& bucket : buckets)
+				bucket.store(0, std::memory_order_relaxed);
+		}
+	};
+
+	explicit MetricShard(int maxMetrics) : histograms(maxMetrics), inUse(true)
+	{
+		for(std::atomic<Histogram*>& histogram : histograms)
+			histogram.store(nullptr, std::memory_order_relaxed);
+	}
+
+	~MetricShard()
+	{
+		for(std::atomic<Histogram*>& histogram : histograms)
+			delete histogram.load(std::memory_order_relaxed);
+	}
+
+	void record(int metric, uint64_t value)
+	{
+		Histogram* histogram = histograms[metric].load(std::memory_order_relaxed);
+		if(!histogram)
+		{
+			histogram = new Histogram;
+			histograms[metric].store(histogram, std::memory_order_release);
+		}
+		bump(histogram->buckets[MetricHistogram::bucket(value)], 1);
+		bump(histogram->count, 1);
+		bump(histogram->sum, value);
+		if(value < histogram->min.load(std::memory_order_relaxed))
+			histogram->min.store(value, std::memory_order_relaxed);
+		if(value > histogram->max.load(std::memory_order_relaxed))
+			histogram->max.store(value, std::memory_order_relaxed);
+	}
+
+	// adds this thread's values of metric to histogram
+	void addTo(int metric, MetricHistogram& histogram) const
+	{
+		const Histogram* recorded = histograms[metric].load(std::memory_order_acquire);
+		if(!recorded)
+			return;
+		for(int index = 0; index < MetricHistogram::numBuckets; ++index)
+			histogram.buckets[index] += recorded->buckets[index].load(std::memory_order_relaxed);
+		histogram.count += recorded->count.load(std::memory_order_relaxed);
+		histogram.sum += recorded->sum.load(std::memory_order_relaxed);
+		histogram.min = std::min(histogram.min, recorded->min.load(std::memory_order_relaxed));
+		histogram.max = std::max(histogram.max, recorded->max.load(std::memory_order_relaxed));
+	}
+
+	std::vector<std::atomic<Histogram*>> histograms;
+	// false once the owning thread exited, the next new thread takes the shard over
+	std::atomic<bool> inUse;
+
+private:
+	static void bump(std::atomic<uint64_t>& value, uint64_t amount)
+	{
+		value.store(value.load(std::memory_order_relaxed) + amount, std::memory_order_relaxed);
+	}
+};
+
+struct MetricSummary
+{
+	std::string name;
+	MetricUnit unit;
+	MetricHistogram histogram;
+};
+
+// Every metric merged over all threads at one point in time. Two snapshots give the
+// values recorded in between, for periodic summaries.
+class MetricsSnapshot
+{
+public:
+	std::vector<MetricSummary> metrics;
+
+	// what was recorded since earlier
+	MetricsSnapshot since(const MetricsSnapshot& earlier) const
+	{
+		MetricsSnapshot interval = *this;
+		for(std::size_t metric = 0; metric < std::min(metrics.size(), earlier.metrics.size()); ++metric)
+			interval.metrics[metric].histogram.subtract(earlier.metrics[metric].histogram);
+		return interval;
+	}
+
+	// one line per recorded metric, latencies in milliseconds
+	void print(std::ostream& out) const
+	{
+		const std::ios::fmtflags flags = out.flags();
+		const std::streamsize precision = out.precision();
+		out << std::left << std::setw(34) << "metric" << std::right << std::setw(9) << "count" << std::setw(12) << "mean"
+			<< std::setw(12) << "p50" << std::setw(12) << "p90" << std::setw(12) << "p99" << std::setw(12) << "max" << "\n";
+		for(const MetricSummary& metric : metrics)
+		{
+			const MetricHistogram& histogram = metric.histogram;
+			if(histogram.count == 0)
+				continue;
+			const bool latency = metric.unit == MetricUnit::Nanoseconds;
+			const double scale = latency ? 1e-6 : 1.0;
+			out << std::left << std::setw(34) << metric.name + (latency ? " (ms)" : "") << std::right << std::setw(9) << histogram.count
+				<< std::fixed << std::setprecision(latency ? 3 : 1)
+				<< std::setw(12) << histogram.mean() * scale << std::setw(12) << histogram.percentile(0.5) * scale
+				<< std::setw(12) << histogram.percentile(0.9) * scale << std::setw(12) << histogram.percentile(0.99) * scale
+				<< std::setw(12) << histogram.max * scale << "\n";
+		}
+		out.flags(flags);
+		out.precision(precision);
+	}
+
+	// an object keyed by metric name, raw values in the metric's unit
+	void writeJson(std::ostream& out, const std::string& indent = "") const
+	{
+		const std::ios::fmtflags flags = out.flags();
+		const std::streamsize precision = out.precision();
+		out << std::fixed << std::setprecision(1) << "{";
+		bool first = true;
+		for(const MetricSummary& metric : metrics)
+		{
+			const MetricHistogram& histogram = metric.histogram;
+			if(histogram.count == 0)
+				continue;
+			out << (first ? "\n" : ",\n") << indent << "  \"" << metric.name << "\": {\"unit\": \""
+				<< (metric.unit == MetricUnit::Nanoseconds ? "ns" : "count") << "\", \"count\": " << histogram.count
+				<< ", \"sum\": " << histogram.sum << ", \"mean\": " << histogram.mean() << ", \"min\": " << histogram.min
+				<< ", \"p50\": " << histogram.percentile(0.5) << ", \"p90\": " << histogram.percentile(0.9)
+				<< ", \"p99\": " << histogram.percentile(0.99) << ", \"max\": " << histogram.max << "}";
+			first = false;
+		}
+		out << (first ? "}" : "\n" + indent + "}");
+		out.flags(flags);
+		out.precision(precision);
+	}
+};
+
+// Named metrics, each a histogram per recording thread. id() is looked up once per call
+// site and cached in a function local static; record() then only touches the calling
+// thread's shard. Threads get a shard on their first record and hand it back when they
+// exit. Stage log lines go through log(), which setConsole(false) silences without the
+// lines being formatted.
+class MetricsRegistry
+{
+public:
+	static const int maxMetrics = 128;
+
+	MetricsRegistry() : consoleEnabled(true) {}
+
+	// id of the metric called name, registering it on first use; -1 once maxMetrics are taken
+	int id(const std::string& name, MetricUnit unit)
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		for(std::size_t metric = 0; metric < names.size(); ++metric)
+			if(names[metric] == name)
+				return int(metric);
+		if(names.size() == std::size_t(maxMetrics))
+			return -1;
+		names.push_back(name);
+		units.push_back(unit);
+		return int(names.size()) - 1;
+	}
+
+	void record(int metric, uint64_t value)
+	{
+		if(metric >= 0)
+			threadShard().record(metric, value);
+	}
+
+	MetricsSnapshot snapshot()
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		MetricsSnapshot snapshot;
+		snapshot.metrics.resize(names.size());
+		for(std::size_t metric = 0; metric < names.size(); ++metric)
+		{
+			snapshot.metrics[metric].name = names[metric];
+			snapshot.metrics[metric].unit = units[metric];
+			for(const std::unique_ptr<MetricShard>& shard : shards)
+				shard->addTo(int(metric), snapshot.metrics[metric].histogram);
+		}
+		return snapshot;
+	}
+
+	void setConsole(bool enabled) { consoleEnabled.store(enabled, std::memory_order_relaxed); }
+
+	bool console() const { return consoleEnabled.load(std::memory_order_relaxed); }
+
+	// std::cout, or a stream in a failed state that drops everything when the console is off
+	std::ostream& log()
+	{
+		// per thread, as even a failed stream updates its state on every write
+		thread_local std::ostream silent(nullptr);
+		return console() ? std::cout : silent;
+	}
+
+private:
+	struct ShardHandle
+	{
+		MetricShard* shard = nullptr;
+		~ShardHandle()
+		{
+			if(shard)
+				shard->inUse.store(false, std::memory_order_release);
+		}
+	};
+
+	MetricShard& threadShard()
+	{
+		thread_local ShardHandle handle;
+		if(!handle.shard)
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			for(const std::unique_ptr<MetricShard>& shard : shards)
+				if(!shard->inUse.load(std::memory_order_acquire))
+				{
+					shard->inUse.store(true, std::memory_order_relaxed);
+					handle.shard = shard.get();
+					break;
+				}
+			if(!handle.shard)
+			{
+				shards.emplace_back(new MetricShard(maxMetrics));
+				handle.shard = shards.back().get();
+			}
+		}
+		return *handle.shard;
+	}
+
+	std::mutex mutex;
+	std::vector<std::string> names;
+	std::vector<MetricUnit> units;
+	std::vector<std::unique_ptr<MetricShard>> shards;
+	std::atomic<bool> consoleEnabled;
+};
+
+// The process wide registry. Never destroyed, so threads of other static objects such as
+// sharedThreadPool() can still hand back their shards while the program exits.
+inline MetricsRegistry& metrics()
+{
+	static MetricsRegistry* registry = new MetricsRegistry;
+	return *registry;
+}
+
+// Latency and points in and out of one processing stage, <stage>.latency,
+// <stage>.points_in and <stage>.points_out
+struct StageMetrics
+{
+	int latency;
+	int pointsIn;
+	int pointsOut;
+
+	explicit StageMetrics(const std::string& stage)
+		: latency(metrics().id(stage + ".latency", MetricUnit::Nanoseconds)),
+		  pointsIn(metrics().id(stage + ".points_in", MetricUnit::Count)),
+		  pointsOut(metrics().id(stage + ".points_out", MetricUnit::Count))
+	{}
+};
+
+// Times a stage from construction to stop()
+class StageTimer
+{
+public:
+	explicit StageTimer(const StageMetrics& setStage)
+		: stage(setStage), startTime(std::chrono::steady_clock::now())
+	{}
+
+	// records the latency, returns it in milliseconds
+	double stop()
+	{
+		const uint64_t elapsed = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - startTime).count();
+		metrics().record(stage.latency, elapsed);
+		return elapsed / 1e6;
+	}
+
+	// records the latency and point counts, returns the latency in milliseconds
+	double stop(std::size_t pointsIn, std::size_t pointsOut)
+	{
+		metrics().record(stage.pointsIn, pointsIn);
+		metrics().record(stage.pointsOut, pointsOut);
+		return stop();
+	}
+
+private:
+	const StageMetrics& stage;
+	std::chrono::steady_clock::time_point startTime;
+};
+
+#endif /* METRICS_H */
@@ -0,0 +1,170 @@
+// Minimal thread pool and helpers for splitting work over cores
+
+#ifndef PARALLEL_H
+#define PARALLEL_H
+
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <atomic>
+#include <memory>
+#include <deque>
+#include <vector>
+#include <algorithm>
+#include <cstddef>
+
+// Number of worker threads to use, 0 or less means one per hardware thread
+inline int resolveThreadCount(int numThreads)
+{
+	if(numThreads > 0)
+		return numThreads;
+	int hardwareThreads = int(std::thread::hardware_concurrency());
+	return hardwareThreads > 0 ? hardwareThreads : 1;
+}
+
+// Fixed set of worker threads fed from one job queue. The thread calling run() works
+// on its own batch too, so nested run() calls from inside a task cannot deadlock.
+class ThreadPool
+{
+public:
+	explicit ThreadPool(int numWorkers)
+		: stopping(false)
+	{
+		for(int worker = 0; worker < numWorkers; ++worker)
+			workers.emplace_back([this]() { workerLoop(); });
+	}
+
+	~ThreadPool()
+	{
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			stopping = true;
+		}
+		wakeWorkers.notify_all();
+		for(std::thread& worker : workers)
+			worker.join();
+	}
+
+	int size() const { return int(workers.size()); }
+
+	// calls task(taskId) for every taskId in [0, numTasks) and returns once all finished
+	template<typename Function>
+	void run(int numTasks, Function task)
+	{
+		if(numTasks <= 0)
+			return;
+
+		std::shared_ptr<Batch> batch = std::make_shared<Batch>(numTasks);
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			for(int taskId = 1; taskId < numTasks; ++taskId)
+				jobs.emplace_back([batch, task, taskId]() { task(taskId); batch->finish(); });
+		}
+		wakeWorkers.notify_all();
+
+		task(0);
+		batch->finish();
+
+		// help with queued jobs, ours or anyone's, until this batch is done
+		while(!batch->done())
+		{
+			std::function<void()> job;
+			{
+				std::lock_guard<std::mutex> lock(mutex);
+				if(!jobs.empty())
+				{
+					job = std::move(jobs.front());
+					jobs.pop_front();
+				}
+			}
+			if(job)
+				job();
+			else
+				batch->wait();
+		}
+	}
+
+private:
+	struct Batch
+	{
+		std::atomic<int> remaining;
+		std::mutex mutex;
+		std::condition_variable finished;
+
+		explicit Batch(int numTasks) : remaining(numTasks) {}
+
+		void finish()
+		{
+			if(remaining.fetch_sub(1) == 1)
+			{
+				std::lock_guard<std::mutex> lock(mutex);
+				finished.notify_all();
+			}
+		}
+
+		bool done() const { return remaining.load() == 0; }
+
+		void wait()
+		{
+			std::unique_lock<std::mutex> lock(mutex);
+			finished.wait(lock, [this]() { return remaining.load() == 0; });
+		}
+	};
+
+	void workerLoop()
+	{
+		while(true)
+		{
+			std::function<void()> job;
+			{
+				std::unique_lock<std::mutex> lock(mutex);
+				wakeWorkers.wait(lock, [this]() { return stopping || !jobs.empty(); });
+				if(jobs.empty())
+					return;
+				job = std::move(jobs.front());
+				jobs.pop_front();
+			}
+			job();
+		}
+	}
+
+	std::vector<std::thread> workers;
+	std::deque<std::function<void()>> jobs;
+	std::mutex mutex;
+	std::condition_variable wakeWorkers;
+	bool stopping;
+};
+
+// Process wide pool with one worker less than there are hardware threads, the caller
+// of run() being the remaining one
+inline ThreadPool& sharedThreadPool()
+{
+	static ThreadPool pool(resolveThreadCount(0) - 1);
+	return pool;
+}
+
+// Splits [0, count) into numThreads contiguous chunks and calls
+// function(threadId, chunkBegin, chunkEnd) for each on the shared pool.
+// Chunk boundaries only depend on count and numThreads.
+template<typename Function>
+void parallelFor(std::size_t count, int numThreads, Function function)
+{
+	numThreads = std::max(1, std::min(numThreads, int(count)));
+	const std::size_t chunk = (count + numThreads - 1) / numThreads;
+
+	if(numThreads == 1)
+	{
+		function(0, std::size_t(0), count);
+		return;
+	}
+
+	sharedThreadPool().run(numThreads, [&](int threadId)
+	{
+		std::size_t begin = std::min(count, threadId * chunk);
+		std::size_t end = std::min(count, begin + chunk);
+		function(threadId, begin, end);
+	});
+}
+
+#endif /* PARALLEL_H */
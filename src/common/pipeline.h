@@ -0,0 +1,91 @@
+// Linear chain of processing stages, one thread each, joined by bounded queues
+
+#ifndef PIPELINE_H
+#define PIPELINE_H
+
+#include <functional>
+#include <memory>
+#include <thread>
+#include <atomic>
+#include <vector>
+#include <cstddef>
+#include "boundedQueue.h"
+
+// A source thread produces items, every stage runs on its own thread and works on one item
+// at a time, and the caller takes finished items from the last queue with pop(). While one
+// item is being loaded the ones before it are processed and rendered, so throughput
+// approaches that of the slowest stage. Items never overtake each other, they come out in
+// the order the source produced them. Every queue holds at most queueCapacity items and a
+// full queue stalls the stage feeding it, which bounds memory when the consumer falls
+// behind. Stages are only ever called from their own thread, so state carried from one
+// item to the next needs no locking; state shared between stages does.
+template<typename Item>
+class Pipeline
+{
+public:
+	// fills in the next item, false once there is none
+	typedef std::function<bool(Item&)> Source;
+	typedef std::function<void(Item&)> Stage;
+
+	Pipeline(Source source, std::vector<Stage> stages, std::size_t queueCapacity)
+		: stopping(false)
+	{
+		for(std::size_t queue = 0; queue <= stages.size(); ++queue)
+			queues.emplace_back(new BoundedQueue<Item>(queueCapacity));
+
+		threads.emplace_back([this, source]()
+		{
+			Item item;
+			while(!stopping.load() && source(item))
+				if(!queues.front()->push(item))
+					break;
+			queues.front()->close();
+		});
+		for(std::size_t stage = 0; stage < stages.size(); ++stage)
+			threads.emplace_back([this, stage, work = stages[stage]]()
+			{
+				Item item;
+				while(!stopping.load() && queues[stage]->pop(item))
+				{
+					work(item);
+					if(!queues[stage + 1]->push(item))
+						break;
+				}
+				queues[stage + 1]->close();
+			});
+	}
+
+	~Pipeline()
+	{
+		stop();
+		for(std::thread& thread : threads)
+			thread.join();
+	}
+
+	// next finished item in source order, false when the source ran out or after stop()
+	bool pop(Item& item) { return queues.back()->pop(item); }
+
+	// let every thread finish its current item and exit, items still queued are dropped
+	void stop()
+	{
+		stopping.store(true);
+		for(std::unique_ptr<BoundedQueue<Item>>& queue : queues)
+			queue->close();
+	}
+
+	// items waiting in front of every stage, the last entry being the finished ones
+	std::vector<std::size_t> queueDepths() const
+	{
+		std::vector<std::size_t> depths;
+		for(const std::unique_ptr<BoundedQueue<Item>>& queue : queues)
+			depths.push_back(queue->size());
+		return depths;
+	}
+
+private:
+	std::vector<std::unique_ptr<BoundedQueue<Item>>> queues;
+	std::vector<std::thread> threads;
+	std::atomic<bool> stopping;
+};
+
+#endif /* PIPELINE_H */
@@ -7,6 +7,8 @@
 #include "processPointClouds.h"
 // using templates for processPointClouds so also include .cpp to help linker
 #include "processPointClouds.cpp"
+#include "obstacleStages.h"
+#include "common/pipeline.h"
 
 
 std::vector<Car> initHighway(bool renderScene, pcl::visualization::PCLVisualizer::Ptr& viewer)
@@ -71,7 +73,7 @@ void simpleHighway(pcl::visualization::PCLVisualizer::Ptr& viewer)
     for(pcl::PointCloud<pcl::PointXYZ>::Ptr cluster : cloudClusters)
     {
        
-        std::cout << "cluster size ";
+        metrics().log() << "cluster size ";
         pointProcessor.numPoints(cluster);
         renderPointCloud(viewer,cluster,"obstCloud"+std::to_string(clusterId),colors[clusterId]); //compute the minimum oriented bounding box (OBB) 
 
@@ -85,38 +87,40 @@ void simpleHighway(pcl::visualization::PCLVisualizer::Ptr& viewer)
     renderPointCloud(viewer, segmentCloud.second, "planeCloud", Color(0,1,0));
 }
 
-// For working with real point cloud data
-void cityBlock(pcl::visualization::PCLVisualizer::Ptr& viewer, ProcessPointClouds<pcl::PointXYZI> pointProcessorI, const pcl::PointCloud<pcl::PointXYZI>::Ptr& inputCloud)
+void renderObstacles(pcl::visualization::PCLVisualizer::Ptr& viewer, const ObstacleFrame& frame)
 {
+    // renderPointCloud(viewer, frame.filteredCloud, "voxelDownSampledCloud");
+    // renderPointCloud(viewer, frame.segmentCloud.first, "obstCloud", Color(1,0,0));
+    renderPointCloud(viewer, frame.segmentCloud.second, "planeCloud", Color(0,1,0));
 
-    pcl::PointCloud<pcl::PointXYZI>::Ptr voxelDownSampledCloud =  pointProcessorI.FilterCloud(inputCloud, 0.2f , Eigen::Vector4f (-10, -5, -5, 1), Eigen::Vector4f ( 30, 6, 5, 1) );
-    // renderPointCloud(viewer, voxelDownSampledCloud, "voxelDownSampledCloud");
-
-    // segmentation
-    std::pair<pcl::PointCloud<pcl::PointXYZI>::Ptr, pcl::PointCloud<pcl::PointXYZI>::Ptr> segmentCloud = pointProcessorI.SegmentPlane(voxelDownSampledCloud, 300, 0.2);
-    // renderPointCloud(viewer, segmentCloud.first, "obstCloud", Color(1,0,0));
-    renderPointCloud(viewer, segmentCloud.second, "planeCloud", Color(0,1,0));
-
-    // clustering
-    std::vector<pcl::PointCloud<pcl::PointXYZI>::Ptr> cloudClusters = pointProcessorI.Clustering(segmentCloud.first, 0.4, 10, 600);
     int clusterId = 0;
     std::vector<Color> colors = {Color(1,0,0), Color(0,1,0), Color(0,0,1), Color(1,0,1), Color(0,1,1), Color(1,0,1), Color(1,1,0), Color(1,1,1)};
 
-    for(pcl::PointCloud<pcl::PointXYZI>::Ptr cluster : cloudClusters)
+    for(pcl::PointCloud<pcl::PointXYZI>::Ptr cluster : frame.cloudClusters)
     {
-       
-        std::cout << "cluster size ";
-        pointProcessorI.numPoints(cluster);
-        renderPointCloud(viewer,cluster,"obstCloud"+std::to_string(clusterId),colors[clusterId]); 
+
+        metrics().log() << "cluster size " << cluster->points.size() << std::endl;
+        renderPointCloud(viewer,cluster,"obstCloud"+std::to_string(clusterId),colors[clusterId % colors.size()]);
 
         // create bounding box around obstacle clusters
-        // Box box = pointProcessorI.BoundingBox(cluster);
-        BoxQ boxqPCA = pointProcessorI.BoundingBoxPCA(cluster);//compute the minimum oriented bounding box (OBB) 
-        renderBox(viewer, boxqPCA, clusterId);
-   
+        // renderBox(viewer, frame.clusterFeatures[clusterId].box, clusterId);
+        renderBox(viewer, frame.clusterFeatures[clusterId].boxQ, clusterId);//the minimum oriented bounding box (OBB)
+        // yaw only box on the ground, does not tilt or flip between frames:
+        // renderBox(viewer, footprintBox(*cluster, FootprintFit::Closeness), clusterId);
+
         ++clusterId;
     }
-    // renderPointCloud(viewer, segmentCloud.second, "planeCloud", Color(0,1,0));
+}
+
+// For working with real point cloud data
+void cityBlock(pcl::visualization::PCLVisualizer::Ptr& viewer, ProcessPointClouds<pcl::PointXYZI>& pointProcessorI, const pcl::PointCloud<pcl::PointXYZI>::Ptr& inputCloud)
+{
+    ObstacleFrame frame;
+    frame.inputCloud = inputCloud;
+    filterStage(pointProcessorI, frame);
+    segmentStage(pointProcessorI, frame);
+    clusterStage(pointProcessorI, frame);
+    renderObstacles(viewer, frame);
 }
 
 //setAngle: SWITCH CAMERA ANGLE {XY, TopDown, Side, FPS}
@@ -153,27 +157,85 @@ int main (int argc, char** argv)
     // simpleHighway(viewer);
 
     ProcessPointClouds<pcl::PointXYZI> pointProcessorI;
-    std::vector<boost::filesystem::path> stream = pointProcessorI.streamPcd("../src/sensors/data/pcd/data_2");
-    auto streamIterator = stream.begin();
-    pcl::PointCloud<pcl::PointXYZI>::Ptr inputCloudI;
-
-    // cityBlock(viewer, pointProcessorI, inputCloudI);
+    // stop ground RANSAC once 99% confident instead of always running every iteration
+    pointProcessorI.setRansacConfidence(0.99);
+    pointProcessorI.setRansacRefinement(true);
+    // a pcd directory or a replay archive made from one with the archive tool, --quiet
+    // leaves only the periodic metrics summary on the console, --metrics <file> writes
+    // every stage's latency and point counts as JSON when the viewer is closed
+    std::string dataPath = "../src/sensors/data/pcd/data_2";
+    std::string metricsPath;
+    for (int arg = 1; arg < argc; ++arg)
+    {
+        if (std::string(argv[arg]) == "--quiet")
+            metrics().setConsole(false);
+        else if (std::string(argv[arg]) == "--metrics" && arg + 1 < argc)
+            metricsPath = argv[++arg];
+        else
+            dataPath = argv[arg];
+    }
+    FrameStream<pcl::PointXYZI> stream = pointProcessorI.streamFrames(dataPath);
+
+    // cityBlock(viewer, pointProcessorI, pointProcessorI.loadFrame(stream, 0));
+
+    // Loading, filtering, segmentation and clustering each run on their own thread while
+    // this one renders, frames come out in stream order. The stages share pointProcessorI
+    // but each touches only its own part of its state.
+    std::size_t streamIndex = 0;
+    Pipeline<ObstacleFrame> pipeline(
+        [&](ObstacleFrame& frame)
+        {
+            if(stream.size() == 0)
+                return false;
+            frame = ObstacleFrame();
+            frame.path = stream.name(streamIndex);
+            frame.restart = streamIndex == 0;
+            frame.inputCloud = pointProcessorI.loadFrame(stream, streamIndex);
+            streamIndex = (streamIndex + 1) % stream.size();
+            // the disk can read ahead while this frame is processed
+            stream.prefetch(streamIndex);
+            return true;
+        },
+        {
+            [&](ObstacleFrame& frame) { filterStage(pointProcessorI, frame); },
+            [&](ObstacleFrame& frame) { segmentStage(pointProcessorI, frame); },
+            [&](ObstacleFrame& frame) { clusterStage(pointProcessorI, frame); }
+        },
+        2);
+
+    // stage metrics of the last summaryFrames frames
+    const int summaryFrames = 50;
+    MetricsSnapshot lastSummary = metrics().snapshot();
+    int framesShown = 0;
+
+    ObstacleFrame frame;
+    while (!viewer->wasStopped () && pipeline.pop(frame)){
 
-    while (!viewer->wasStopped ()){
-        
         // Clear viewer
         viewer->removeAllPointClouds();
         viewer->removeAllShapes();
 
-        // Load pcd and run obstacle detection process
-        std::cout << (*streamIterator).string() << std::endl;
-        inputCloudI = pointProcessorI.loadPcd((*streamIterator).string());
-        cityBlock(viewer, pointProcessorI, inputCloudI);
+        metrics().log() << frame.path << std::endl;
+        renderObstacles(viewer, frame);
+
+        std::vector<std::size_t> depths = pipeline.queueDepths();
+        metrics().log() << "pipeline queues loaded " << depths[0] << ", filtered " << depths[1] << ", segmented " << depths[2] << ", clustered " << depths[3] << std::endl;
 
-        streamIterator++;
-        if(streamIterator == stream.end())
-            streamIterator = stream.begin();
+        if (++framesShown % summaryFrames == 0)
+        {
+            MetricsSnapshot summary = metrics().snapshot();
+            std::cout << "stage metrics over the last " << summaryFrames << " frames" << std::endl;
+            summary.since(lastSummary).print(std::cout);
+            lastSummary = summary;
+        }
 
         viewer->spin();
     }
-}
\ No newline at end of file
+
+    if (!metricsPath.empty())
+    {
+        std::ofstream out(metricsPath);
+        metrics().snapshot().writeJson(out);
+        out << std::endl;
+    }
+}
@@ -0,0 +1,313 @@
+// Single pass and multi-threaded region, roof and voxel grid filters used by ProcessPointClouds::FilterCloud
+
+#ifndef VOXELFILTER_H
+#define VOXELFILTER_H
+
+#include <pcl/common/common.h>
+#include <Eigen/Dense>
+#include <unordered_map>
+#include <algorithm>
+#include <vector>
+#include <cstdint>
+#include <cmath>
+#include "../common/parallel.h"
+
+// Reads and writes intensity for point types that carry it, no-op for the rest
+template<typename PointT>
+struct PointIntensity
+{
+	static float get(const PointT& point) { return 0.f; }
+	static void set(PointT& point, float value) {}
+};
+
+template<>
+struct PointIntensity<pcl::PointXYZI>
+{
+	static float get(const pcl::PointXYZI& point) { return point.intensity; }
+	static void set(pcl::PointXYZI& point, float value) { point.intensity = value; }
+};
+
+// Running sums of every point that fell into one voxel
+struct VoxelAccumulator
+{
+	uint64_t key;
+	double x, y, z, intensity;
+	int count;
+};
+
+// Voxel indices are packed 21 bits per axis with z most significant, so sorting
+// keys orders voxels the same way pcl::VoxelGrid emits them (z, then y, then x)
+const int voxelKeyBits = 21;
+const int64_t voxelKeyOffset = int64_t(1) << (voxelKeyBits - 1);
+const uint64_t voxelKeyMask = (uint64_t(1) << voxelKeyBits) - 1;
+
+inline uint64_t voxelKey(int64_t i, int64_t j, int64_t k)
+{
+	return (uint64_t((k + voxelKeyOffset) & voxelKeyMask) << (2 * voxelKeyBits)) |
+		   (uint64_t((j + voxelKeyOffset) & voxelKeyMask) << voxelKeyBits) |
+		    uint64_t((i + voxelKeyOffset) & voxelKeyMask);
+}
+
+// Region and roof boxes shared by the voxel filters. The region and roof tests are
+// applied to voxel centroids like the PCL chain, but whole voxels can be rejected up
+// front when they lie outside the region or completely inside the roof.
+struct VoxelBounds
+{
+	float leafSize, inverseLeaf;
+	Eigen::Vector4f minPoint, maxPoint;
+	Eigen::Vector4f roofMin, roofMax;
+	// voxel index ranges that can still produce a centroid inside the region
+	int64_t regionMin[3], regionMax[3];
+	// voxel index ranges that lie completely inside the roof box
+	int64_t roofInnerMin[3], roofInnerMax[3];
+
+	VoxelBounds(float setLeafSize, Eigen::Vector4f setMinPoint, Eigen::Vector4f setMaxPoint, Eigen::Vector4f setRoofMin, Eigen::Vector4f setRoofMax)
+		: leafSize(setLeafSize), inverseLeaf(1.f / setLeafSize), minPoint(setMinPoint), maxPoint(setMaxPoint), roofMin(setRoofMin), roofMax(setRoofMax)
+	{
+		for(int axis = 0; axis < 3; ++axis)
+		{
+			regionMin[axis] = int64_t(std::floor(minPoint[axis] * inverseLeaf));
+			regionMax[axis] = int64_t(std::floor(maxPoint[axis] * inverseLeaf));
+			roofInnerMin[axis] = int64_t(std::ceil(roofMin[axis] * inverseLeaf));
+			roofInnerMax[axis] = int64_t(std::floor(roofMax[axis] * inverseLeaf)) - 1;
+		}
+	}
+
+	static bool inside(float x, float y, float z, const Eigen::Vector4f& boxMin, const Eigen::Vector4f& boxMax)
+	{
+		return x >= boxMin[0] && x <= boxMax[0] && y >= boxMin[1] && y <= boxMax[1] && z >= boxMin[2] && z <= boxMax[2];
+	}
+
+	// computes the voxel of a point, false when no centroid of that voxel can survive
+	template<typename PointT>
+	bool voxelOf(const PointT& point, bool isDense, int64_t& i, int64_t& j, int64_t& k) const
+	{
+		if(!isDense && !(std::isfinite(point.x) && std::isfinite(point.y) && std::isfinite(point.z)))
+			return false;
+
+		i = int64_t(std::floor(point.x * inverseLeaf));
+		j = int64_t(std::floor(point.y * inverseLeaf));
+		k = int64_t(std::floor(point.z * inverseLeaf));
+
+		if(i < regionMin[0] || i > regionMax[0] || j < regionMin[1] || j > regionMax[1] || k < regionMin[2] || k > regionMax[2])
+			return false;
+		return !(i >= roofInnerMin[0] && i <= roofInnerMax[0] && j >= roofInnerMin[1] && j <= roofInnerMax[1] && k >= roofInnerMin[2] && k <= roofInnerMax[2]);
+	}
+
+	// turns a voxel sum into its centroid, false when the centroid is filtered out
+	template<typename PointT>
+	bool centroidOf(const VoxelAccumulator& voxel, PointT& centroid) const
+	{
+		centroid.x = float(voxel.x / voxel.count);
+		centroid.y = float(voxel.y / voxel.count);
+		centroid.z = float(voxel.z / voxel.count);
+		PointIntensity<PointT>::set(centroid, float(voxel.intensity / voxel.count));
+
+		return inside(centroid.x, centroid.y, centroid.z, minPoint, maxPoint) && !inside(centroid.x, centroid.y, centroid.z, roofMin, roofMax);
+	}
+};
+
+// Fuses the three FilterCloud passes (voxel grid, region crop, roof removal) into one
+// sweep over the input using a hashed voxel map. Output matches the PCL chain up to
+// float summation order.
+template<typename PointT>
+struct FusedVoxelFilter
+{
+	VoxelBounds bounds;
+
+	std::unordered_map<uint64_t, int> voxelSlots;
+	std::vector<VoxelAccumulator> voxels;
+
+	FusedVoxelFilter(float setLeafSize, Eigen::Vector4f setMinPoint, Eigen::Vector4f setMaxPoint, Eigen::Vector4f setRoofMin, Eigen::Vector4f setRoofMax)
+		: bounds(setLeafSize, setMinPoint, setMaxPoint, setRoofMin, setRoofMax)
+	{}
+
+	void filter(const pcl::PointCloud<PointT>& cloud, pcl::PointCloud<PointT>& output)
+	{
+		voxelSlots.clear();
+		voxelSlots.reserve(cloud.points.size() / 4);
+		voxels.clear();
+
+		for(const PointT& point : cloud.points)
+		{
+			int64_t i, j, k;
+			if(!bounds.voxelOf(point, cloud.is_dense, i, j, k))
+				continue;
+
+			const uint64_t key = voxelKey(i, j, k);
+			auto slot = voxelSlots.emplace(key, int(voxels.size()));
+			if(slot.second)
+				voxels.push_back(VoxelAccumulator{key, 0.0, 0.0, 0.0, 0.0, 0});
+
+			VoxelAccumulator& voxel = voxels[slot.first->second];
+			voxel.x += point.x;
+			voxel.y += point.y;
+			voxel.z += point.z;
+			voxel.intensity += PointIntensity<PointT>::get(point);
+			++voxel.count;
+		}
+
+		std::sort(voxels.begin(), voxels.end(), [](const VoxelAccumulator& a, const VoxelAccumulator& b) { return a.key < b.key; });
+
+		output.points.clear();
+		output.points.reserve(voxels.size());
+		for(const VoxelAccumulator& voxel : voxels)
+		{
+			PointT centroid;
+			if(bounds.centroidOf(voxel, centroid))
+				output.points.push_back(centroid);
+		}
+		output.width = output.points.size();
+		output.height = 1;
+		output.is_dense = true;
+	}
+};
+
+// Point index tagged with the dense index of its voxel, the unit sorted by ParallelVoxelFilter
+struct VoxelEntry
+{
+	uint64_t key;
+	int index;
+};
+
+// Stable LSD radix sort of entries on the low keyBits bits of their key, buffer is
+// scratch space. Every pass histograms per thread, turns the histograms into per thread
+// bucket offsets and scatters each chunk in order, so the result is the same for any
+// thread count.
+inline void radixSortEntries(std::vector<VoxelEntry>& entries, std::vector<VoxelEntry>& buffer, int keyBits, int numThreads)
+{
+	const int radixBits = 8;
+	const int radixBuckets = 1 << radixBits;
+	const std::size_t numEntries = entries.size();
+	buffer.resize(numEntries);
+	std::vector<std::size_t> offsets(std::size_t(numThreads) * radixBuckets);
+
+	for(int shift = 0; shift < keyBits; shift += radixBits)
+	{
+		std::fill(offsets.begin(), offsets.end(), 0);
+		parallelFor(numEntries, numThreads, [&](int threadId, std::size_t begin, std::size_t end)
+		{
+			std::size_t* histogram = &offsets[std::size_t(threadId) * radixBuckets];
+			for(std::size_t position = begin; position < end; ++position)
+				++histogram[(entries[position].key >> shift) & (radixBuckets - 1)];
+		});
+
+		// bucket major, thread minor prefix sum keeps the scatter stable
+		std::size_t total = 0;
+		for(int bucket = 0; bucket < radixBuckets; ++bucket)
+		{
+			for(int threadId = 0; threadId < numThreads; ++threadId)
+			{
+				std::size_t& slot = offsets[std::size_t(threadId) * radixBuckets + bucket];
+				std::size_t count = slot;
+				slot = total;
+				total += count;
+			}
+		}
+
+		parallelFor(numEntries, numThreads, [&](int threadId, std::size_t begin, std::size_t end)
+		{
+			std::size_t* offset = &offsets[std::size_t(threadId) * radixBuckets];
+			for(std::size_t position = begin; position < end; ++position)
+				buffer[offset[(entries[position].key >> shift) & (radixBuckets - 1)]++] = entries[position];
+		});
+		entries.swap(buffer);
+	}
+}
+
+// Multi-threaded voxel grid: voxel keys are computed in parallel, entries are grouped
+// by a parallel LSD radix sort and every thread reduces the centroids of a contiguous
+// run of voxels. The sort is stable and each voxel is summed by exactly one thread in
+// input order, so the output is identical for any thread count.
+template<typename PointT>
+struct ParallelVoxelFilter
+{
+	VoxelBounds bounds;
+	int numThreads;
+
+	std::vector<VoxelEntry> entries, sortBuffer;
+
+	ParallelVoxelFilter(float setLeafSize, Eigen::Vector4f setMinPoint, Eigen::Vector4f setMaxPoint, Eigen::Vector4f setRoofMin, Eigen::Vector4f setRoofMax, int setNumThreads)
+		: bounds(setLeafSize, setMinPoint, setMaxPoint, setRoofMin, setRoofMax), numThreads(resolveThreadCount(setNumThreads))
+	{}
+
+	void filter(const pcl::PointCloud<PointT>& cloud, pcl::PointCloud<PointT>& output)
+	{
+		// Keys are dense indices inside the region box ordered z, y, x like pcl::VoxelGrid,
+		// so the radix sort only has to cover as many bits as the region needs
+		const uint64_t sizeX = uint64_t(bounds.regionMax[0] - bounds.regionMin[0] + 1);
+		const uint64_t sizeY = uint64_t(bounds.regionMax[1] - bounds.regionMin[1] + 1);
+		const uint64_t sizeZ = uint64_t(bounds.regionMax[2] - bounds.regionMin[2] + 1);
+		const uint64_t maxKey = sizeX * sizeY * sizeZ;
+
+		// 1. compute keys per chunk, then concatenate kept entries in chunk order
+		const std::size_t numPoints = cloud.points.size();
+		std::vector<std::vector<VoxelEntry>> chunkEntries(numThreads);
+		parallelFor(numPoints, numThreads, [&](int threadId, std::size_t begin, std::size_t end)
+		{
+			std::vector<VoxelEntry>& local = chunkEntries[threadId];
+			local.clear();
+			local.reserve(end - begin);
+			for(std::size_t index = begin; index < end; ++index)
+			{
+				int64_t i, j, k;
+				if(!bounds.voxelOf(cloud.points[index], cloud.is_dense, i, j, k))
+					continue;
+				uint64_t key = (uint64_t(k - bounds.regionMin[2]) * sizeY + uint64_t(j - bounds.regionMin[1])) * sizeX + uint64_t(i - bounds.regionMin[0]);
+				local.push_back(VoxelEntry{key, int(index)});
+			}
+		});
+
+		entries.clear();
+		for(const std::vector<VoxelEntry>& local : chunkEntries)
+			entries.insert(entries.end(), local.begin(), local.end());
+
+		// 2. group entries by key
+		int keyBits = 0;
+		while(keyBits < 64 && (maxKey >> keyBits) != 0)
+			++keyBits;
+		radixSortEntries(entries, sortBuffer, keyBits, numThreads);
+
+		// 3. each thread reduces the voxels that start inside its chunk
+		const std::size_t numEntries = entries.size();
+		std::vector<std::vector<PointT>> chunkCentroids(numThreads);
+		parallelFor(numEntries, numThreads, [&](int threadId, std::size_t begin, std::size_t end)
+		{
+			// skip the tail of a voxel owned by the previous chunk
+			while(begin < end && begin > 0 && entries[begin].key == entries[begin - 1].key)
+				++begin;
+
+			std::vector<PointT>& local = chunkCentroids[threadId];
+			local.clear();
+			std::size_t position = begin;
+			while(position < end)
+			{
+				VoxelAccumulator voxel{entries[position].key, 0.0, 0.0, 0.0, 0.0, 0};
+				// a voxel that starts in this chunk is finished here even if it runs past end
+				while(position < numEntries && entries[position].key == voxel.key)
+				{
+					const PointT& point = cloud.points[entries[position].index];
+					voxel.x += point.x;
+					voxel.y += point.y;
+					voxel.z += point.z;
+					voxel.intensity += PointIntensity<PointT>::get(point);
+					++voxel.count;
+					++position;
+				}
+
+				PointT centroid;
+				if(bounds.centroidOf(voxel, centroid))
+					local.push_back(centroid);
+			}
+		});
+
+		output.points.clear();
+		for(const std::vector<PointT>& local : chunkCentroids)
+			output.points.insert(output.points.end(), local.begin(), local.end());
+		output.width = output.points.size();
+		output.height = 1;
+		output.is_dense = true;
+	}
+};
+
+#endif /* VOXELFILTER_H */
@@ -0,0 +1,260 @@
+// Records clouds to disk from a background thread as binary PCD or .pcq frames
+
+#ifndef FRAMERECORDER_H
+#define FRAMERECORDER_H
+
+#include <boost/filesystem.hpp>
+#include <pcl/common/common.h>
+#include <string>
+#include <vector>
+#include <sstream>
+#include <fstream>
+#include <memory>
+#include <thread>
+#include <chrono>
+#include <cstring>
+#include <cstdint>
+#include <cstddef>
+#include "../common/boundedQueue.h"
+#include "pointCodec.h"
+#ifndef _WIN32
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+// What record() does when the writer has fallen a full queue behind
+enum class RecordPolicy
+{
+	// wait for room, nothing is lost but the caller runs at disk speed
+	Block,
+	// return at once and count the cloud as dropped, the caller never waits
+	Drop
+};
+
+struct RecorderOptions
+{
+	// clouds waiting to be written
+	std::size_t queueCapacity;
+	RecordPolicy policy;
+	// .pcq through io/pointCodec.h instead of binary PCD
+	bool compress;
+	PointCodecParams codec;
+	// files written between two syncs, every file is on disk after close()
+	int syncEvery;
+
+	RecorderOptions()
+		: queueCapacity(32), policy(RecordPolicy::Block), compress(false), syncEvery(32)
+	{}
+};
+
+// Filled in by the writer thread, complete once close() returned
+struct RecorderStats
+{
+	std::size_t recorded = 0;
+	std::size_t dropped = 0;
+	// files that could not be encoded or written, not counted in recorded
+	std::size_t failed = 0;
+	std::size_t syncs = 0;
+	// fsyncs of recorded files or their directory that failed, the data may not be on disk
+	std::size_t syncFailures = 0;
+	uint64_t bytes = 0;
+	// most clouds ever waiting, a queue that reaches capacity means the disk is too slow
+	std::size_t maxQueued = 0;
+	// time the writer spent encoding, writing and syncing
+	double writeMs = 0;
+};
+
+inline int pcdFieldCount(const pcl::PointXYZI&) { return 4; }
+template<typename PointT>
+int pcdFieldCount(const PointT&) { return 3; }
+
+// Binary PCD with float x, y, z (and intensity for PointXYZI), what PCL's
+// savePCDFileBinary writes for these types and MappedPcd reads back
+template<typename PointT>
+void encodeBinaryPcd(const pcl::PointCloud<PointT>& cloud, std::vector<unsigned char>& out)
+{
+	const int fields = pcdFieldCount(PointT());
+	const std::size_t numPoints = cloud.points.size();
+	const bool organized = cloud.height > 1 && std::size_t(cloud.width) * cloud.height == numPoints;
+	std::ostringstream header;
+	header << "# .PCD v0.7 - Point Cloud Data file format\n"
+	       << "VERSION 0.7\n"
+	       << (fields == 4 ? "FIELDS x y z intensity\nSIZE 4 4 4 4\nTYPE F F F F\nCOUNT 1 1 1 1\n" : "FIELDS x y z\nSIZE 4 4 4\nTYPE F F F\nCOUNT 1 1 1\n")
+	       << "WIDTH " << (organized ? cloud.width : numPoints) << "\n"
+	       << "HEIGHT " << (organized ? cloud.height : 1) << "\n"
+	       << "VIEWPOINT 0 0 0 1 0 0 0\n"
+	       << "POINTS " << numPoints << "\n"
+	       << "DATA binary\n";
+	const std::string text = header.str();
+
+	out.resize(text.size() + numPoints * fields * sizeof(float));
+	std::memcpy(out.data(), text.data(), text.size());
+	unsigned char* record = out.data() + text.size();
+	for(const PointT& point : cloud.points)
+	{
+		const float values[4] = {point.x, point.y, point.z, codecIntensity(point)};
+		std::memcpy(record, values, fields * sizeof(float));
+		record += fields * sizeof(float);
+	}
+}
+
+// Hands clouds to one writer thread through a BoundedQueue, so recording costs the caller
+// a shared pointer copy. Clouds are shared, not copied: they must not change after
+// record(), which holds for the fresh clouds every processing stage returns. The writer
+// encodes into one reused buffer and writes each file with a single call, syncing files
+// and directory every syncEvery files instead of after each one, so a crash loses at most
+// that many recent files. record() is called from one thread at a time, like push() on
+// the queue.
+template<typename PointT>
+class FrameRecorder
+{
+public:
+	FrameRecorder() : recording(false) {}
+	~FrameRecorder() { close(); }
+
+	FrameRecorder(const FrameRecorder&) = delete;
+	FrameRecorder& operator=(const FrameRecorder&) = delete;
+
+	// starts the writer, false if directory cannot be created
+	bool open(const std::string& setDirectory, const RecorderOptions& setOptions = RecorderOptions())
+	{
+		close();
+		directory = setDirectory;
+		options = setOptions;
+		statistics = RecorderStats();
+		boost::system::error_code error;
+		boost::filesystem::create_directories(directory, error);
+		if(!boost::filesystem::is_directory(directory))
+			return false;
+		queue.reset(new BoundedQueue<Item>(std::max<std::size_t>(1, options.queueCapacity)));
+		recording = true;
+		writer = std::thread(&FrameRecorder::run, this);
+		return true;
+	}
+
+	bool isOpen() const { return recording; }
+
+	// queues cloud for directory/name.pcd (or .pcq), false if it was dropped or the
+	// recorder is closed
+	bool record(typename pcl::PointCloud<PointT>::ConstPtr cloud, const std::string& name)
+	{
+		if(!recording || !cloud)
+			return false;
+		Item item{cloud, name};
+		const bool queued = options.policy == RecordPolicy::Block ? queue->push(item) : queue->tryPush(item);
+		if(!queued)
+			++statistics.dropped;
+		statistics.maxQueued = std::max(statistics.maxQueued, queue->size());
+		return queued;
+	}
+
+	// writes what is queued, syncs it and stops the writer
+	void close()
+	{
+		if(!recording)
+			return;
+		queue->close();
+		writer.join();
+		queue.reset();
+		recording = false;
+	}
+
+	const RecorderStats& stats() const { return statistics; }
+
+private:
+	struct Item
+	{
+		typename pcl::PointCloud<PointT>::ConstPtr cloud;
+		std::string name;
+	};
+
+	void run()
+	{
+		std::vector<unsigned char> buffer;
+		Item item;
+		while(queue->pop(item))
+		{
+			auto startTime = std::chrono::steady_clock::now();
+			bool encoded = true;
+			if(options.compress)
+				encoded = encodePoints(*item.cloud, options.codec, buffer);
+			else
+				encodeBinaryPcd(*item.cloud, buffer);
+			item.cloud.reset();
+			const std::string path = directory + "/" + item.name + (options.compress ? ".pcq" : ".pcd");
+			if(encoded && writeFile(path, buffer))
+			{
+				++statistics.recorded;
+				statistics.bytes += buffer.size();
+			}
+			else
+				++statistics.failed;
+			if(int(unsynced.size()) >= std::max(1, options.syncEvery))
+				sync();
+			statistics.writeMs += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - startTime).count();
+		}
+		auto startTime = std::chrono::steady_clock::now();
+		sync();
+		statistics.writeMs += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - startTime).count();
+	}
+
+	bool writeFile(const std::string& path, const std::vector<unsigned char>& data)
+	{
+#ifndef _WIN32
+		const int descriptor = ::open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+		if(descriptor < 0)
+			return false;
+		std::size_t written = 0;
+		while(written < data.size())
+		{
+			const ssize_t count = ::write(descriptor, data.data() + written, data.size() - written);
+			if(count <= 0)
+			{
+				::close(descriptor);
+				return false;
+			}
+			written += count;
+		}
+		// kept open until the next sync so it can be flushed without opening it again
+		unsynced.push_back(descriptor);
+		return true;
+#else
+		std::ofstream out(path, std::ios::binary | std::ios::trunc);
+		out.write(reinterpret_cast<const char*>(data.data()), data.size());
+		unsynced.push_back(0);
+		return bool(out);
+#endif
+	}
+
+	// flushes the files written since the last sync, then the directory entries naming them
+	void sync()
+	{
+		if(unsynced.empty())
+			return;
+#ifndef _WIN32
+		for(int descriptor : unsynced)
+		{
+			if(::fsync(descriptor) != 0)
+				++statistics.syncFailures;
+			::close(descriptor);
+		}
+		const int folder = ::open(directory.c_str(), O_RDONLY);
+		if(folder < 0 || ::fsync(folder) != 0)
+			++statistics.syncFailures;
+		if(folder >= 0)
+			::close(folder);
+#endif
+		unsynced.clear();
+		++statistics.syncs;
+	}
+
+	std::string directory;
+	RecorderOptions options;
+	RecorderStats statistics;
+	std::unique_ptr<BoundedQueue<Item>> queue;
+	std::thread writer;
+	std::vector<int> unsynced;
+	bool recording;
+};
+
+#endif /* FRAMERECORDER_H */
@@ -0,0 +1,92 @@
+// Sequence of lidar frames from either a directory of pcd files or a replay archive
+
+#ifndef FRAMESTREAM_H
+#define FRAMESTREAM_H
+
+#include <boost/filesystem.hpp>
+#include <pcl/io/pcd_io.h>
+#include <memory>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include "mappedPcd.h"
+#include "replayArchive.h"
+#include "pointCodec.h"
+
+// Frames are addressed by index in playback order, so the replay loop doesn't care where
+// they come from. A directory lists its files sorted by name like streamPcd, .pcq files
+// are decoded by io/pointCodec.h, binary pcds are read through MappedPcd and anything else
+// through PCL. An archive is mapped once and
+// every frame read from it is a single copy out of the mapping.
+template<typename PointT>
+class FrameStream
+{
+public:
+	// false if path is neither a directory nor a valid archive
+	bool open(const std::string& path)
+	{
+		paths.clear();
+		archive.reset();
+		if(boost::filesystem::is_directory(path))
+		{
+			for(boost::filesystem::directory_iterator entry(path), end; entry != end; ++entry)
+				if(boost::filesystem::is_regular_file(entry->path()))
+					paths.push_back(entry->path());
+			std::sort(paths.begin(), paths.end());
+			return true;
+		}
+		archive.reset(new ReplayArchive);
+		if(!archive->open(path))
+		{
+			archive.reset();
+			return false;
+		}
+		return true;
+	}
+
+	bool fromArchive() const { return bool(archive); }
+
+	std::size_t size() const { return archive ? archive->size() : paths.size(); }
+
+	// source file of a frame
+	std::string name(std::size_t frame) const { return archive ? archive->name(frame) : paths[frame].string(); }
+
+	// false if a pcd file could not be read
+	bool load(std::size_t frame, pcl::PointCloud<PointT>& cloud) const
+	{
+		if(archive)
+		{
+			archive->copyTo(frame, cloud);
+			return true;
+		}
+		if(isPointCodecFile(paths[frame].string()))
+			return loadPointCodecFile(paths[frame].string(), cloud);
+		MappedPcd mapped;
+		if(mapped.open(paths[frame].string()))
+		{
+			mapped.copyTo(cloud);
+			return true;
+		}
+		return pcl::io::loadPCDFile<PointT>(paths[frame].string(), cloud) != -1;
+	}
+
+	// starts reading a frame that will be loaded soon
+	void prefetch(std::size_t frame) const
+	{
+		if(frame >= size())
+			return;
+		if(archive)
+			archive->prefetch(frame);
+		else
+			MappedFile::prefetch(paths[frame].string());
+	}
+
+	// the mapped archive, empty for a directory
+	const ReplayArchive* getArchive() const { return archive.get(); }
+
+private:
+	std::vector<boost::filesystem::path> paths;
+	std::shared_ptr<ReplayArchive> archive;
+};
+
+#endif /* FRAMESTREAM_H */
@@ -0,0 +1,333 @@
+// Memory mapped reader for binary PCD files
+
+#ifndef MAPPEDPCD_H
+#define MAPPEDPCD_H
+
+#include <pcl/common/common.h>
+#include <string>
+#include <vector>
+#include <sstream>
+#include <fstream>
+#include <cstring>
+#include <cmath>
+#include <algorithm>
+#include <limits>
+#include <cstddef>
+#include <cstdint>
+#ifndef _WIN32
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+// Read only view of a whole file. On POSIX systems the file is mapped, with its pages
+// faulted in up front unless populate is off (large files read in parts), elsewhere it is
+// read into memory.
+class MappedFile
+{
+public:
+	MappedFile() : bytes(nullptr), length(0) {}
+	~MappedFile() { close(); }
+
+	MappedFile(const MappedFile&) = delete;
+	MappedFile& operator=(const MappedFile&) = delete;
+
+	bool open(const std::string& path, bool populate = true)
+	{
+		close();
+#ifndef _WIN32
+		const int descriptor = ::open(path.c_str(), O_RDONLY);
+		if(descriptor < 0)
+			return false;
+		struct stat status;
+		if(fstat(descriptor, &status) != 0 || status.st_size == 0)
+		{
+			::close(descriptor);
+			return false;
+		}
+		int flags = MAP_PRIVATE;
+#ifdef MAP_POPULATE
+		if(populate)
+			flags |= MAP_POPULATE;
+#endif
+		void* mapped = mmap(nullptr, status.st_size, PROT_READ, flags, descriptor, 0);
+		::close(descriptor);
+		if(mapped == MAP_FAILED)
+			return false;
+		bytes = static_cast<const char*>(mapped);
+		length = status.st_size;
+#else
+		(void)populate;
+		std::ifstream in(path, std::ios::binary | std::ios::ate);
+		if(!in)
+			return false;
+		buffer.resize(std::size_t(in.tellg()));
+		in.seekg(0);
+		if(buffer.empty() || !in.read(&buffer[0], buffer.size()))
+			return false;
+		bytes = buffer.data();
+		length = buffer.size();
+#endif
+		return true;
+	}
+
+	void close()
+	{
+#ifndef _WIN32
+		if(bytes)
+			munmap(const_cast<char*>(bytes), length);
+#else
+		buffer.clear();
+#endif
+		bytes = nullptr;
+		length = 0;
+	}
+
+	const char* data() const { return bytes; }
+	std::size_t size() const { return length; }
+
+	// hint that [offset, offset + count) will be read soon, the kernel reads it ahead
+	void willNeed(std::size_t offset, std::size_t count) const
+	{
+#if !defined(_WIN32) && defined(MADV_WILLNEED)
+		if(!bytes || offset >= length)
+			return;
+		// madvise wants a page aligned start
+		const std::size_t page = std::size_t(sysconf(_SC_PAGESIZE));
+		const std::size_t start = offset / page * page;
+		madvise(const_cast<char*>(bytes) + start, std::min(length, offset + count) - start, MADV_WILLNEED);
+#else
+		(void)offset;
+		(void)count;
+#endif
+	}
+
+	// Asks the kernel to start reading a file that will be opened soon, so its pages are
+	// cached by then. Returns at once; false if the hint could not be given.
+	static bool prefetch(const std::string& path)
+	{
+#if !defined(_WIN32) && defined(POSIX_FADV_WILLNEED)
+		const int descriptor = ::open(path.c_str(), O_RDONLY);
+		if(descriptor < 0)
+			return false;
+		const bool given = posix_fadvise(descriptor, 0, 0, POSIX_FADV_WILLNEED) == 0;
+		::close(descriptor);
+		return given;
+#else
+		(void)path;
+		return false;
+#endif
+	}
+
+private:
+	const char* bytes;
+	std::size_t length;
+#ifdef _WIN32
+	std::vector<char> buffer;
+#endif
+};
+
+// The header fields of a PCD file that describe the point layout
+struct PcdHeader
+{
+	std::vector<std::string> fields;
+	std::vector<int> sizes;
+	std::vector<char> types;
+	std::vector<int> counts;
+	std::size_t width = 0;
+	std::size_t height = 0;
+	std::size_t points = 0;
+	std::string data;
+	// byte offset of the first point, after the DATA line
+	std::size_t dataOffset = 0;
+
+	// byte offset of a field within a point, -1 if the file doesn't have it
+	int fieldOffset(const std::string& name) const
+	{
+		int offset = 0;
+		for(std::size_t field = 0; field < fields.size(); ++field)
+		{
+			if(fields[field] == name)
+				return offset;
+			offset += sizes[field] * counts[field];
+		}
+		return -1;
+	}
+
+	std::size_t pointSize() const
+	{
+		std::size_t size = 0;
+		for(std::size_t field = 0; field < fields.size(); ++field)
+			size += std::size_t(sizes[field]) * counts[field];
+		return size;
+	}
+
+	// true for a single 4 byte float
+	bool isFloat(const std::string& name) const
+	{
+		for(std::size_t field = 0; field < fields.size(); ++field)
+			if(fields[field] == name)
+				return types[field] == 'F' && sizes[field] == 4 && counts[field] == 1;
+		return false;
+	}
+
+	// Parses the text header at the start of text, false if it is not a PCD header
+	bool parse(const char* text, std::size_t length)
+	{
+		std::size_t position = 0;
+		while(position < length)
+		{
+			const char* lineEnd = static_cast<const char*>(std::memchr(text + position, '\n', length - position));
+			const std::size_t end = lineEnd ? lineEnd - text : length;
+			std::istringstream line(std::string(text + position, end - position));
+			position = end + 1;
+
+			std::string key;
+			line >> key;
+			if(key.empty() || key[0] == '#' || key == "VERSION" || key == "VIEWPOINT")
+				continue;
+			else if(key == "FIELDS")
+				for(std::string name; line >> name; )
+					fields.push_back(name);
+			else if(key == "SIZE")
+				for(int size; line >> size; )
+					sizes.push_back(size);
+			else if(key == "TYPE")
+				for(char type; line >> type; )
+					types.push_back(type);
+			else if(key == "COUNT")
+				for(int count; line >> count; )
+					counts.push_back(count);
+			else if(key == "WIDTH")
+				line >> width;
+			else if(key == "HEIGHT")
+				line >> height;
+			else if(key == "POINTS")
+				line >> points;
+			else if(key == "DATA")
+			{
+				line >> data;
+				dataOffset = std::min(position, length);
+				break;
+			}
+			else
+				return false;
+		}
+		// COUNT is optional and defaults to 1
+		if(counts.empty())
+			counts.assign(fields.size(), 1);
+		if(points == 0)
+			points = width * height;
+		if(data.empty() || fields.empty() || sizes.size() != fields.size() || types.size() != fields.size() || counts.size() != fields.size())
+			return false;
+		// sizes and counts are summed into the unsigned pointSize() and int field offsets
+		for(std::size_t field = 0; field < fields.size(); ++field)
+			if(sizes[field] <= 0 || sizes[field] > 8 || counts[field] <= 0)
+				return false;
+		return pointSize() <= std::size_t(std::numeric_limits<int>::max());
+	}
+};
+
+inline void assignIntensity(pcl::PointXYZI& point, float intensity) { point.intensity = intensity; }
+template<typename PointT>
+void assignIntensity(PointT&, float) {}
+
+// A binary PCD file mapped into memory. open() validates the header once: the data must be
+// binary, with float x, y and z (intensity is optional), and the file must hold every
+// point. Points are then read straight from the mapping at the field offsets found in the
+// header, without parsing anything per point.
+class MappedPcd
+{
+public:
+	MappedPcd() : stride(0), xOffset(-1), yOffset(-1), zOffset(-1), intensityOffset(-1) {}
+
+	// false if the file is missing or not a binary PCD this reader supports
+	bool open(const std::string& path)
+	{
+		header = PcdHeader();
+		if(!file.open(path))
+			return false;
+		// the header is a few hundred bytes, never parse into the point data
+		if(!header.parse(file.data(), std::min<std::size_t>(file.size(), 4096)) || header.data != "binary")
+			return fail();
+		if(!header.isFloat("x") || !header.isFloat("y") || !header.isFloat("z"))
+			return fail();
+
+		stride = header.pointSize();
+		xOffset = header.fieldOffset("x");
+		yOffset = header.fieldOffset("y");
+		zOffset = header.fieldOffset("z");
+		intensityOffset = header.isFloat("intensity") ? header.fieldOffset("intensity") : -1;
+		// as a count against the bytes left, a corrupt POINTS cannot wrap the product
+		if(header.points > (file.size() - header.dataOffset) / stride)
+			return fail();
+		return true;
+	}
+
+	std::size_t size() const { return header.points; }
+	const PcdHeader& getHeader() const { return header; }
+
+	// the raw points, size() records of pointStride() bytes each
+	const char* pointData() const { return file.data() + header.dataOffset; }
+	std::size_t pointStride() const { return stride; }
+
+	float x(std::size_t index) const { return field(index, xOffset); }
+	float y(std::size_t index) const { return field(index, yOffset); }
+	float z(std::size_t index) const { return field(index, zOffset); }
+	float intensity(std::size_t index) const { return intensityOffset < 0 ? 0.f : field(index, intensityOffset); }
+
+	// bulk copy of all points into cloud, replacing its contents
+	template<typename PointT>
+	void copyTo(pcl::PointCloud<PointT>& cloud) const
+	{
+		const std::size_t numPoints = size();
+		cloud.points.resize(numPoints);
+		cloud.width = header.height > 1 ? header.width : numPoints;
+		cloud.height = header.height > 1 ? header.height : 1;
+
+		bool dense = true;
+		const char* record = pointData();
+		for(std::size_t index = 0; index < numPoints; ++index, record += stride)
+		{
+			PointT& point = cloud.points[index];
+			std::memcpy(&point.x, record + xOffset, sizeof(float));
+			std::memcpy(&point.y, record + yOffset, sizeof(float));
+			std::memcpy(&point.z, record + zOffset, sizeof(float));
+			float value = 0;
+			if(intensityOffset >= 0)
+				std::memcpy(&value, record + intensityOffset, sizeof(float));
+			assignIntensity(point, value);
+			dense &= std::isfinite(point.x) && std::isfinite(point.y) && std::isfinite(point.z);
+		}
+		cloud.is_dense = dense;
+	}
+
+	void close()
+	{
+		file.close();
+		header = PcdHeader();
+	}
+
+private:
+	bool fail()
+	{
+		close();
+		return false;
+	}
+
+	// memcpy as records need not be aligned
+	float field(std::size_t index, int offset) const
+	{
+		float value;
+		std::memcpy(&value, pointData() + index * stride + offset, sizeof(float));
+		return value;
+	}
+
+	MappedFile file;
+	PcdHeader header;
+	std::size_t stride;
+	int xOffset, yOffset, zOffset, intensityOffset;
+};
+
+#endif /* MAPPEDPCD_H */
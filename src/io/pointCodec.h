@@ -0,0 +1,357 @@
+// Lossy compressed storage of point frames: quantized, delta coded and bit packed
+
+#ifndef POINTCODEC_H
+#define POINTCODEC_H
+
+#include <pcl/common/common.h>
+#include <vector>
+#include <string>
+#include <fstream>
+#include <limits>
+#include <cstring>
+#include <cstdint>
+#include <cstddef>
+#include <cmath>
+#include <algorithm>
+#include "mappedPcd.h"
+
+// Layout, the header and index integers in the writing host's byte order, which the
+// header records:
+//   PointCodecHeader                     52 bytes
+//   blocks of up to pointCodecBlock points, for each of x, y, z, intensity in turn:
+//     1 byte bit width w, then the block's values packed w bits each, padded to a byte,
+//     least significant bit first on any host
+//   uint32 indices of the points that were not finite
+// Coordinates are rounded to multiples of precision and stored as the zigzag coded
+// difference to the previous point (lidar frames are stored in scan order, so neighbours
+// are close); the first point's grid position is in the header. Intensity is scaled
+// linearly between the frame's minimum and maximum into intensityBits bits. Every block
+// packs each channel with the fewest bits its largest value needs, so the decoder only
+// shifts and masks.
+
+static const char pointCodecMagic[4] = {'P', 'C', 'Q', '1'};
+static const uint32_t pointCodecVersion = 2;
+static const uint32_t pointCodecByteOrder = 0x01020304;
+static const int pointCodecBlock = 128;
+
+struct PointCodecParams
+{
+	// coordinate step in metres, the coordinate error is at most half of it
+	float precision;
+	// 8 or 16
+	int intensityBits;
+
+	PointCodecParams(float setPrecision = 0.001f, int setIntensityBits = 8)
+		: precision(setPrecision), intensityBits(setIntensityBits)
+	{}
+};
+
+struct PointCodecHeader
+{
+	char magic[4];
+	uint32_t version;
+	// reads back as 0x01020304 only on a host of the same byte order
+	uint32_t byteOrder;
+	uint32_t numPoints;
+	uint32_t numNonFinite;
+	float precision;
+	float intensityMin;
+	float intensityMax;
+	uint32_t intensityBits;
+	int32_t origin[3];
+	uint32_t payloadBytes;
+};
+
+static_assert(sizeof(PointCodecHeader) == 52, "point codec header layout");
+
+inline uint32_t zigzagEncode(int32_t value) { return (uint32_t(value) << 1) ^ uint32_t(value >> 31); }
+inline int32_t zigzagDecode(uint32_t value) { return int32_t(value >> 1) ^ -int32_t(value & 1); }
+
+// Appends values with width bits each to out, padded to a whole byte
+inline void packBits(const uint32_t* values, int count, int width, std::vector<unsigned char>& out)
+{
+	uint64_t buffer = 0;
+	int filled = 0;
+	for(int index = 0; index < count; ++index)
+	{
+		buffer |= uint64_t(values[index]) << filled;
+		filled += width;
+		while(filled >= 8)
+		{
+			out.push_back(static_cast<unsigned char>(buffer));
+			buffer >>= 8;
+			filled -= 8;
+		}
+	}
+	if(filled > 0)
+		out.push_back(static_cast<unsigned char>(buffer));
+}
+
+// Reads count values of width bits from in, returns the bytes consumed. The caller keeps
+// 8 readable bytes past the end, so every value is taken from one unaligned 64 bit load.
+inline std::size_t unpackBits(const unsigned char* in, int count, int width, uint32_t* values)
+{
+	const uint64_t mask = width == 32 ? 0xffffffffull : (1ull << width) - 1;
+	std::size_t bit = 0;
+	for(int index = 0; index < count; ++index, bit += width)
+	{
+		uint64_t word;
+		std::memcpy(&word, in + (bit >> 3), sizeof(word));
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+		word = __builtin_bswap64(word);
+#endif
+		values[index] = uint32_t((word >> (bit & 7)) & mask);
+	}
+	return (bit + 7) >> 3;
+}
+
+inline int bitWidth(uint32_t value)
+{
+	int width = 0;
+	while(value >> width)
+		++width;
+	return width;
+}
+
+inline float codecIntensity(const pcl::PointXYZI& point) { return point.intensity; }
+template<typename PointT>
+float codecIntensity(const PointT&) { return 0.f; }
+
+// Encodes cloud into out. False if precision or intensityBits are unusable or a coordinate
+// is too far out for the integer grid.
+template<typename PointT>
+bool encodePoints(const pcl::PointCloud<PointT>& cloud, const PointCodecParams& params, std::vector<unsigned char>& out)
+{
+	if(!(params.precision > 0) || (params.intensityBits != 8 && params.intensityBits != 16))
+		return false;
+	const int numPoints = cloud.points.size();
+	const double inverse = 1.0 / params.precision;
+	const double limit = double(1 << 29);
+
+	PointCodecHeader header;
+	std::memset(&header, 0, sizeof(header));
+	std::memcpy(header.magic, pointCodecMagic, sizeof(pointCodecMagic));
+	header.version = pointCodecVersion;
+	header.byteOrder = pointCodecByteOrder;
+	header.numPoints = numPoints;
+	header.precision = params.precision;
+	header.intensityBits = params.intensityBits;
+
+	// grid positions, non finite points repeat the previous one so they cost no bits
+	std::vector<int32_t> grid(3 * numPoints);
+	std::vector<uint32_t> nonFinite;
+	header.intensityMin = std::numeric_limits<float>::max();
+	header.intensityMax = -std::numeric_limits<float>::max();
+	int32_t last[3] = {0, 0, 0};
+	bool first = true;
+	for(int index = 0; index < numPoints; ++index)
+	{
+		const PointT& point = cloud.points[index];
+		const float coordinates[3] = {point.x, point.y, point.z};
+		if(!std::isfinite(point.x) || !std::isfinite(point.y) || !std::isfinite(point.z))
+		{
+			nonFinite.push_back(index);
+			std::copy(last, last + 3, &grid[3 * index]);
+			continue;
+		}
+		for(int axis = 0; axis < 3; ++axis)
+		{
+			const double scaled = std::round(coordinates[axis] * inverse);
+			if(std::fabs(scaled) > limit)
+				return false;
+			grid[3 * index + axis] = last[axis] = int32_t(scaled);
+		}
+		if(first)
+		{
+			std::copy(last, last + 3, header.origin);
+			first = false;
+		}
+		const float intensity = codecIntensity(point);
+		if(std::isfinite(intensity))
+		{
+			header.intensityMin = std::min(header.intensityMin, intensity);
+			header.intensityMax = std::max(header.intensityMax, intensity);
+		}
+	}
+	if(header.intensityMin > header.intensityMax)
+		header.intensityMin = header.intensityMax = 0;
+	header.numNonFinite = nonFinite.size();
+
+	const uint32_t intensityLevels = (1u << params.intensityBits) - 1;
+	const float intensityRange = header.intensityMax - header.intensityMin;
+	const float intensityScale = intensityRange > 0 ? intensityLevels / intensityRange : 0.f;
+
+	out.assign(sizeof(header), 0);
+	out.reserve(sizeof(header) + 8 * std::size_t(numPoints));
+	int32_t previous[3] = {header.origin[0], header.origin[1], header.origin[2]};
+	uint32_t values[pointCodecBlock];
+	for(std::size_t begin = 0; begin < numPoints; begin += pointCodecBlock)
+	{
+		const int count = int(std::min<std::size_t>(pointCodecBlock, numPoints - begin));
+		for(int channel = 0; channel < 4; ++channel)
+		{
+			uint32_t widest = 0;
+			for(int offset = 0; offset < count; ++offset)
+			{
+				const int index = begin + offset;
+				if(channel < 3)
+				{
+					values[offset] = zigzagEncode(grid[3 * index + channel] - previous[channel]);
+					previous[channel] = grid[3 * index + channel];
+				}
+				else
+				{
+					const float intensity = codecIntensity(cloud.points[index]);
+					const float level = std::isfinite(intensity) ? (intensity - header.intensityMin) * intensityScale : 0.f;
+					values[offset] = uint32_t(std::min(float(intensityLevels), std::max(0.f, std::round(level))));
+				}
+				widest |= values[offset];
+			}
+			const int width = bitWidth(widest);
+			out.push_back(static_cast<unsigned char>(width));
+			packBits(values, count, width, out);
+		}
+	}
+	for(uint32_t index : nonFinite)
+	{
+		unsigned char bytes[4];
+		std::memcpy(bytes, &index, sizeof(index));
+		out.insert(out.end(), bytes, bytes + 4);
+	}
+
+	header.payloadBytes = out.size() - sizeof(header);
+	std::memcpy(out.data(), &header, sizeof(header));
+	return true;
+}
+
+// true if data starts with a point codec header of this version and byte order
+inline bool isPointCodec(const unsigned char* data, std::size_t size)
+{
+	PointCodecHeader header;
+	if(size < sizeof(header))
+		return false;
+	std::memcpy(&header, data, sizeof(header));
+	return std::memcmp(header.magic, pointCodecMagic, sizeof(pointCodecMagic)) == 0 && header.version == pointCodecVersion
+		&& header.byteOrder == pointCodecByteOrder;
+}
+
+// Decodes an encoded frame into cloud, replacing its contents. False on a damaged or
+// truncated frame.
+template<typename PointT>
+bool decodePoints(const unsigned char* data, std::size_t size, pcl::PointCloud<PointT>& cloud)
+{
+	if(!isPointCodec(data, size))
+		return false;
+	PointCodecHeader header;
+	std::memcpy(&header, data, sizeof(header));
+	if(size < sizeof(header) + header.payloadBytes || header.numNonFinite > header.numPoints
+		|| (header.intensityBits != 8 && header.intensityBits != 16))
+		return false;
+
+	// unpackBits may read 8 bytes past a channel, so work on a padded copy of the tail
+	// only when the payload ends closer than that to the end of the buffer
+	const unsigned char* payload = data + sizeof(header);
+	const std::size_t payloadBytes = header.payloadBytes;
+	std::vector<unsigned char> padded;
+	if(size < sizeof(header) + payloadBytes + 8)
+	{
+		padded.assign(payload, payload + payloadBytes);
+		padded.resize(payloadBytes + 8, 0);
+		payload = padded.data();
+	}
+
+	// every block holds at least its four width bytes, so a point count the payload cannot
+	// hold is rejected before the cloud is allocated for it
+	const std::size_t numPoints = header.numPoints;
+	const std::size_t numBlocks = (numPoints + pointCodecBlock - 1) / pointCodecBlock;
+	const std::size_t nonFiniteBytes = 4 * std::size_t(header.numNonFinite);
+	if(payloadBytes < 4 * numBlocks + nonFiniteBytes)
+		return false;
+	const std::size_t blockBytes = payloadBytes - nonFiniteBytes;
+
+	cloud.points.resize(numPoints);
+	cloud.width = numPoints;
+	cloud.height = 1;
+
+	const float precision = header.precision;
+	const float intensityLevels = float((1u << header.intensityBits) - 1);
+	const float intensityStep = intensityLevels > 0 ? (header.intensityMax - header.intensityMin) / intensityLevels : 0.f;
+
+	int32_t previous[3] = {header.origin[0], header.origin[1], header.origin[2]};
+	uint32_t values[pointCodecBlock];
+	float coordinates[3][pointCodecBlock];
+	std::size_t position = 0;
+	for(std::size_t begin = 0; begin < numPoints; begin += pointCodecBlock)
+	{
+		const int count = int(std::min<std::size_t>(pointCodecBlock, numPoints - begin));
+		for(int channel = 0; channel < 4; ++channel)
+		{
+			if(position >= blockBytes)
+				return false;
+			const int width = payload[position++];
+			if(width > 32 || position + (std::size_t(count) * width + 7) / 8 > blockBytes)
+				return false;
+			position += unpackBits(payload + position, count, width, values);
+			PointT* points = &cloud.points[begin];
+			if(channel < 3)
+			{
+				// summed unsigned so a damaged delta wraps instead of overflowing
+				uint32_t value = uint32_t(previous[channel]);
+				for(int offset = 0; offset < count; ++offset)
+				{
+					value += uint32_t(zigzagDecode(values[offset]));
+					coordinates[channel][offset] = int32_t(value) * precision;
+				}
+				previous[channel] = int32_t(value);
+			}
+			else
+				for(int offset = 0; offset < count; ++offset)
+				{
+					points[offset].x = coordinates[0][offset];
+					points[offset].y = coordinates[1][offset];
+					points[offset].z = coordinates[2][offset];
+					assignIntensity(points[offset], header.intensityMin + values[offset] * intensityStep);
+				}
+		}
+	}
+	if(position != blockBytes)
+		return false;
+
+	const float nan = std::numeric_limits<float>::quiet_NaN();
+	for(uint32_t nonFinite = 0; nonFinite < header.numNonFinite; ++nonFinite)
+	{
+		uint32_t index;
+		std::memcpy(&index, payload + blockBytes + 4 * nonFinite, sizeof(index));
+		if(index >= numPoints)
+			return false;
+		cloud.points[index].x = cloud.points[index].y = cloud.points[index].z = nan;
+	}
+	cloud.is_dense = header.numNonFinite == 0;
+	return true;
+}
+
+template<typename PointT>
+bool savePointCodecFile(const std::string& path, const pcl::PointCloud<PointT>& cloud, const PointCodecParams& params = PointCodecParams())
+{
+	std::vector<unsigned char> encoded;
+	if(!encodePoints(cloud, params, encoded))
+		return false;
+	std::ofstream out(path, std::ios::binary | std::ios::trunc);
+	out.write(reinterpret_cast<const char*>(encoded.data()), encoded.size());
+	return bool(out);
+}
+
+template<typename PointT>
+bool loadPointCodecFile(const std::string& path, pcl::PointCloud<PointT>& cloud)
+{
+	MappedFile file;
+	return file.open(path) && decodePoints(reinterpret_cast<const unsigned char*>(file.data()), file.size(), cloud);
+}
+
+// true for file names ending in .pcq, the extension loadPcd and savePcd use this codec for
+inline bool isPointCodecFile(const std::string& path)
+{
+	return path.size() >= 4 && path.compare(path.size() - 4, 4, ".pcq") == 0;
+}
+
+#endif /* POINTCODEC_H */
@@ -0,0 +1,303 @@
+// Single file archive of a lidar frame sequence, memory mapped for replay
+
+#ifndef REPLAYARCHIVE_H
+#define REPLAYARCHIVE_H
+
+#include <pcl/common/common.h>
+#include <string>
+#include <vector>
+#include <fstream>
+#include <cstring>
+#include <cstdint>
+#include <cstddef>
+#include <cmath>
+#include <algorithm>
+#include "mappedPcd.h"
+
+// Layout, all integers in the byte order of the writing host, which open() checks
+// through header.byteOrder:
+//   ArchiveHeader                        64 bytes at offset 0
+//   frame blocks                         each starting on a 64 byte boundary, numPoints
+//                                        records of float x, y, z, intensity
+//   ArchiveFrameEntry[frameCount]        the index, at header.indexOffset
+// The index comes last so frames can be streamed out while converting; the header is
+// written again at the end with its final values.
+
+static const char archiveMagic[8] = {'P', 'C', 'D', 'S', 'E', 'Q', '\r', '\n'};
+static const uint32_t archiveVersion = 1;
+static const uint32_t archiveByteOrder = 0x01020304;
+static const std::size_t archiveAlignment = 64;
+
+struct ArchiveHeader
+{
+	char magic[8];
+	uint32_t version;
+	// reads back as 0x01020304 only on a host of the same byte order
+	uint32_t byteOrder;
+	uint32_t frameCount;
+	// bytes per point record, 16
+	uint32_t pointSize;
+	uint64_t indexOffset;
+	uint64_t totalPoints;
+	char reserved[24];
+};
+
+// Per frame metadata kept in the index
+struct ArchiveFrameEntry
+{
+	uint64_t offset;
+	uint32_t numPoints;
+	// organisation of the source cloud, height 1 when unorganised
+	uint32_t width;
+	uint32_t height;
+	uint32_t reserved;
+	// axis aligned bounds of the finite points
+	float minPoint[3];
+	float maxPoint[3];
+	// source file name, zero terminated and cut to fit
+	char name[80];
+};
+
+static_assert(sizeof(ArchiveHeader) == 64, "archive header layout");
+static_assert(sizeof(ArchiveFrameEntry) == 128, "archive index entry layout");
+
+// Zero copy view of one archived frame: size() records of x, y, z, intensity, aligned to
+// 64 bytes, valid while the archive stays open
+struct ArchiveFrameView
+{
+	const float* data;
+	std::size_t count;
+	const ArchiveFrameEntry* entry;
+
+	std::size_t size() const { return count; }
+	float x(std::size_t index) const { return data[4 * index]; }
+	float y(std::size_t index) const { return data[4 * index + 1]; }
+	float z(std::size_t index) const { return data[4 * index + 2]; }
+	float intensity(std::size_t index) const { return data[4 * index + 3]; }
+};
+
+// Writes an archive frame by frame, e.g. from a directory of pcd files
+class ReplayArchiveWriter
+{
+public:
+	ReplayArchiveWriter() : totalPoints(0), position(0) {}
+
+	bool open(const std::string& path)
+	{
+		out.open(path, std::ios::binary | std::ios::trunc);
+		entries.clear();
+		totalPoints = 0;
+		position = 0;
+		if(!out)
+			return false;
+		// placeholder, rewritten by close()
+		ArchiveHeader header = makeHeader(0);
+		write(&header, sizeof(header));
+		return bool(out);
+	}
+
+	template<typename PointT>
+	bool addFrame(const pcl::PointCloud<PointT>& cloud, const std::string& name)
+	{
+		pad();
+		ArchiveFrameEntry entry;
+		std::memset(&entry, 0, sizeof(entry));
+		entry.offset = position;
+		entry.numPoints = cloud.points.size();
+		entry.width = cloud.height > 1 ? cloud.width : cloud.points.size();
+		entry.height = cloud.height > 1 ? cloud.height : 1;
+		std::strncpy(entry.name, name.c_str(), sizeof(entry.name) - 1);
+		for(int axis = 0; axis < 3; ++axis)
+		{
+			entry.minPoint[axis] = std::numeric_limits<float>::max();
+			entry.maxPoint[axis] = -std::numeric_limits<float>::max();
+		}
+
+		// points go out in blocks so a frame never needs a second full copy in memory
+		std::vector<float> block;
+		block.reserve(4 * 4096);
+		for(std::size_t index = 0; index < cloud.points.size(); ++index)
+		{
+			const PointT& point = cloud.points[index];
+			const float values[4] = {point.x, point.y, point.z, intensityOf(point)};
+			block.insert(block.end(), values, values + 4);
+			if(std::isfinite(point.x) && std::isfinite(point.y) && std::isfinite(point.z))
+				for(int axis = 0; axis < 3; ++axis)
+				{
+					entry.minPoint[axis] = std::min(entry.minPoint[axis], values[axis]);
+					entry.maxPoint[axis] = std::max(entry.maxPoint[axis], values[axis]);
+				}
+			if(block.size() == block.capacity())
+			{
+				write(block.data(), block.size() * sizeof(float));
+				block.clear();
+			}
+		}
+		write(block.data(), block.size() * sizeof(float));
+
+		entries.push_back(entry);
+		totalPoints += entry.numPoints;
+		return bool(out);
+	}
+
+	// writes the index and the final header
+	bool close()
+	{
+		pad();
+		const uint64_t indexOffset = position;
+		write(entries.data(), entries.size() * sizeof(ArchiveFrameEntry));
+		ArchiveHeader header = makeHeader(indexOffset);
+		out.seekp(0);
+		out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+		out.close();
+		return !out.fail();
+	}
+
+	std::size_t size() const { return entries.size(); }
+
+private:
+	static float intensityOf(const pcl::PointXYZI& point) { return point.intensity; }
+	template<typename PointT>
+	static float intensityOf(const PointT&) { return 0.f; }
+
+	ArchiveHeader makeHeader(uint64_t indexOffset) const
+	{
+		ArchiveHeader header;
+		std::memset(&header, 0, sizeof(header));
+		std::memcpy(header.magic, archiveMagic, sizeof(archiveMagic));
+		header.version = archiveVersion;
+		header.byteOrder = archiveByteOrder;
+		header.frameCount = entries.size();
+		header.pointSize = 4 * sizeof(float);
+		header.indexOffset = indexOffset;
+		header.totalPoints = totalPoints;
+		return header;
+	}
+
+	void write(const void* data, std::size_t count)
+	{
+		out.write(static_cast<const char*>(data), count);
+		position += count;
+	}
+
+	void pad()
+	{
+		static const char zeros[archiveAlignment] = {};
+		write(zeros, (archiveAlignment - position % archiveAlignment) % archiveAlignment);
+	}
+
+	std::ofstream out;
+	std::vector<ArchiveFrameEntry> entries;
+	uint64_t totalPoints;
+	uint64_t position;
+};
+
+// An archive opened for replay. The file is mapped without reading it in, frames are
+// paged in when first touched or ahead of time through prefetch().
+class ReplayArchive
+{
+public:
+	ReplayArchive() { std::memset(&header, 0, sizeof(header)); }
+
+	// false if the file is not a complete archive of this version and byte order
+	bool open(const std::string& path)
+	{
+		if(!file.open(path, false))
+			return false;
+		if(file.size() < sizeof(ArchiveHeader))
+			return fail();
+		std::memcpy(&header, file.data(), sizeof(header));
+		if(std::memcmp(header.magic, archiveMagic, sizeof(archiveMagic)) != 0 || header.version != archiveVersion
+			|| header.byteOrder != archiveByteOrder || header.pointSize != 4 * sizeof(float))
+			return fail();
+		// bounds compared as counts against the space left, so corrupt offsets cannot wrap
+		if(header.indexOffset % alignof(ArchiveFrameEntry) != 0 || header.indexOffset > file.size()
+			|| header.frameCount > (file.size() - header.indexOffset) / sizeof(ArchiveFrameEntry))
+			return fail();
+		for(std::size_t frame = 0; frame < size(); ++frame)
+		{
+			const ArchiveFrameEntry& frameEntry = entry(frame);
+			if(frameEntry.offset % archiveAlignment != 0 || frameEntry.offset > header.indexOffset
+				|| frameEntry.numPoints > (header.indexOffset - frameEntry.offset) / header.pointSize)
+				return fail();
+		}
+		return true;
+	}
+
+	// true if path starts like an archive, without validating the rest
+	static bool isArchive(const std::string& path)
+	{
+		std::ifstream in(path, std::ios::binary);
+		char magic[sizeof(archiveMagic)];
+		return in.read(magic, sizeof(magic)) && std::memcmp(magic, archiveMagic, sizeof(magic)) == 0;
+	}
+
+	std::size_t size() const { return header.frameCount; }
+
+	const ArchiveFrameEntry& entry(std::size_t frame) const
+	{
+		return reinterpret_cast<const ArchiveFrameEntry*>(file.data() + header.indexOffset)[frame];
+	}
+
+	// source file name of a frame, cut at the end of the entry if it is not terminated
+	std::string name(std::size_t frame) const
+	{
+		const ArchiveFrameEntry& frameEntry = entry(frame);
+		const void* terminator = std::memchr(frameEntry.name, 0, sizeof(frameEntry.name));
+		return std::string(frameEntry.name, terminator ? static_cast<const char*>(terminator) : frameEntry.name + sizeof(frameEntry.name));
+	}
+
+	ArchiveFrameView frame(std::size_t frame) const
+	{
+		const ArchiveFrameEntry& frameEntry = entry(frame);
+		return ArchiveFrameView{reinterpret_cast<const float*>(file.data() + frameEntry.offset), frameEntry.numPoints, &frameEntry};
+	}
+
+	// copies a frame into cloud, replacing its contents
+	template<typename PointT>
+	void copyTo(std::size_t frameIndex, pcl::PointCloud<PointT>& cloud) const
+	{
+		const ArchiveFrameView view = frame(frameIndex);
+		cloud.points.resize(view.size());
+		cloud.width = view.entry->width;
+		cloud.height = view.entry->height;
+		bool dense = true;
+		for(std::size_t index = 0; index < view.size(); ++index)
+		{
+			PointT& point = cloud.points[index];
+			point.x = view.x(index);
+			point.y = view.y(index);
+			point.z = view.z(index);
+			assignIntensity(point, view.intensity(index));
+			dense &= std::isfinite(point.x) && std::isfinite(point.y) && std::isfinite(point.z);
+		}
+		cloud.is_dense = dense;
+	}
+
+	// starts paging in a frame that will be read soon
+	void prefetch(std::size_t frameIndex) const
+	{
+		if(frameIndex >= size())
+			return;
+		const ArchiveFrameEntry& frameEntry = entry(frameIndex);
+		file.willNeed(frameEntry.offset, std::size_t(frameEntry.numPoints) * header.pointSize);
+	}
+
+	void close()
+	{
+		file.close();
+		std::memset(&header, 0, sizeof(header));
+	}
+
+private:
+	bool fail()
+	{
+		close();
+		return false;
+	}
+
+	MappedFile file;
+	ArchiveHeader header;
+};
+
+#endif /* REPLAYARCHIVE_H */
@@ -0,0 +1,52 @@
+// The cityBlock detection chain split into stages over one frame, shared by the viewer
+// and the headless batch runner
+
+#ifndef OBSTACLESTAGES_H_
+#define OBSTACLESTAGES_H_
+
+#include <string>
+#include <vector>
+#include <utility>
+#include "processPointClouds.h"
+
+// Everything the cityBlock stages produce for one frame
+struct ObstacleFrame
+{
+    std::string path;
+    // first frame of a new pass over the stream, ground tracking starts over
+    bool restart = false;
+    pcl::PointCloud<pcl::PointXYZI>::Ptr inputCloud;
+    pcl::PointCloud<pcl::PointXYZI>::Ptr filteredCloud;
+    // (obstacles, ground)
+    std::pair<pcl::PointCloud<pcl::PointXYZI>::Ptr, pcl::PointCloud<pcl::PointXYZI>::Ptr> segmentCloud;
+    std::vector<pcl::PointCloud<pcl::PointXYZI>::Ptr> cloudClusters;
+    ClusterFeatureList clusterFeatures;
+};
+
+inline void filterStage(ProcessPointClouds<pcl::PointXYZI>& pointProcessorI, ObstacleFrame& frame)
+{
+    frame.filteredCloud = pointProcessorI.FilterCloud(frame.inputCloud, 0.2f , Eigen::Vector4f (-10, -5, -5, 1), Eigen::Vector4f ( 30, 6, 5, 1), FilterMethod::Fused);
+}
+
+inline void segmentStage(ProcessPointClouds<pcl::PointXYZI>& pointProcessorI, ObstacleFrame& frame)
+{
+    if(frame.restart)
+        pointProcessorI.resetPlaneTracking();
+
+    // segmentation, reusing the previous frame's ground plane while it still fits
+    frame.segmentCloud = pointProcessorI.SegmentPlaneTracked(frame.filteredCloud, 300, 0.2);
+    // for sloped or curving roads a single plane doesn't fit:
+    // frame.segmentCloud = pointProcessorI.SegmentGroundPolar(frame.filteredCloud, 0.2);
+}
+
+inline void clusterStage(ProcessPointClouds<pcl::PointXYZI>& pointProcessorI, ObstacleFrame& frame)
+{
+    frame.cloudClusters = pointProcessorI.Clustering(frame.segmentCloud.first, 0.4, 10, 600, ClusterMethod::VoxelHash);
+    // scan line clustering needs no spatial index:
+    // frame.cloudClusters = pointProcessorI.Clustering(frame.segmentCloud.first, 0.4, 10, 600, ClusterMethod::RangeImage);
+
+    // bounding boxes of all clusters at once
+    frame.clusterFeatures = pointProcessorI.BoundingBoxes(frame.cloudClusters);
+}
+
+#endif /* OBSTACLESTAGES_H_ */
@@ -4,7 +4,10 @@
 
 //constructor:
 template<typename PointT>
-ProcessPointClouds<PointT>::ProcessPointClouds() {}
+ProcessPointClouds<PointT>::ProcessPointClouds()
+    : numThreads(1), ransacTargetConfidence(0), ransacRefinement(false), ransacSeed(std::random_device{}()),
+      trackedPlaneValid(false), trackedPlane(Eigen::Vector4f::Zero()), trackedInlierRatio(0), trackedPlaneRetention(0.9),
+      clusterImageGeometry(32, 512, float(-25 * M_PI / 180), float(6 * M_PI / 180)) {}
 
 
 //de-constructor:
@@ -12,19 +15,71 @@ template<typename PointT>
 ProcessPointClouds<PointT>::~ProcessPointClouds() {}
 
 
+template<typename PointT>
+void ProcessPointClouds<PointT>::setNumThreads(int threads)
+{
+    numThreads = threads;
+}
+
+
+template<typename PointT>
+void ProcessPointClouds<PointT>::setClusterImageGeometry(const RangeImageGeometry& geometry)
+{
+    clusterImageGeometry = geometry;
+}
+
+
+template<typename PointT>
+void ProcessPointClouds<PointT>::setRansacConfidence(double confidence)
+{
+    ransacTargetConfidence = confidence;
+}
+
+
+template<typename PointT>
+void ProcessPointClouds<PointT>::setRansacRefinement(bool refine)
+{
+    ransacRefinement = refine;
+}
+
+
+template<typename PointT>
+void ProcessPointClouds<PointT>::setRansacSeed(unsigned seed)
+{
+    ransacSeed = seed;
+}
+
+
+template<typename PointT>
+const RansacStats& ProcessPointClouds<PointT>::getRansacStats() const
+{
+    return lastRansacStats;
+}
+
+
 template<typename PointT>
 void ProcessPointClouds<PointT>::numPoints(typename pcl::PointCloud<PointT>::Ptr cloud)
 {
-    std::cout << cloud->points.size() << std::endl;
+    metrics().log() << cloud->points.size() << std::endl;
 }
 
 
+// Ego car roof, removed from every filtered cloud
+static const Eigen::Vector4f roofMinPoint(-1.5, -1.7, -1, 1);
+static const Eigen::Vector4f roofMaxPoint(2.6, 1.7, -0.4, 1);
+
+
 template<typename PointT>
-typename pcl::PointCloud<PointT>::Ptr ProcessPointClouds<PointT>::FilterCloud(typename pcl::PointCloud<PointT>::Ptr cloud, float filterRes, Eigen::Vector4f minPoint, Eigen::Vector4f maxPoint)
+typename pcl::PointCloud<PointT>::Ptr ProcessPointClouds<PointT>::FilterCloud(typename pcl::PointCloud<PointT>::Ptr cloud, float filterRes, Eigen::Vector4f minPoint, Eigen::Vector4f maxPoint, FilterMethod method)
 {
+    if (method == FilterMethod::Fused)
+        return FilterCloudFused(cloud, filterRes, minPoint, maxPoint);
+    if (method == FilterMethod::Parallel)
+        return FilterCloudParallel(cloud, filterRes, minPoint, maxPoint);
 
-    // Time segmentation process
-    auto startTime = std::chrono::steady_clock::now();
+    // Time filtering process
+    static const StageMetrics stageMetrics("filter");
+    StageTimer timer(stageMetrics);
 
     // TODO:: Fill in the function to do voxel grid point reduction and region based filtering
     // Create the filtering object
@@ -47,8 +102,8 @@ typename pcl::PointCloud<PointT>::Ptr ProcessPointClouds<PointT>::FilterCloud(ty
     std::vector<int> indices;
 
     pcl::CropBox<PointT> roof(true);
-    roof.setMin(Eigen::Vector4f (-1.5, -1.7, -1, 1));
-    roof.setMax(Eigen::Vector4f (2.6, 1.7, -0.4, 1));
+    roof.setMin(roofMinPoint);
+    roof.setMax(roofMaxPoint);
     roof.setInputCloud(cloudRegion);
     roof.filter(indices);
  
@@ -62,15 +117,76 @@ typename pcl::PointCloud<PointT>::Ptr ProcessPointClouds<PointT>::FilterCloud(ty
     extract.setNegative(true);
     extract.filter(*cloudRegion);
 
-    auto endTime = std::chrono::steady_clock::now();
-    auto elapsedTime = std::chrono::duration_cast<std::chrono::milliseconds>(endTime - startTime);
-    std::cout << "filtering took " << elapsedTime.count() << " milliseconds" << std::endl;
+    const double elapsedMs = timer.stop(cloud->points.size(), cloudRegion->points.size());
+    metrics().log() << "filtering took " << elapsedMs << " milliseconds" << std::endl;
+
+    return cloudRegion;
+
+}
+
+
+template<typename PointT>
+typename pcl::PointCloud<PointT>::Ptr ProcessPointClouds<PointT>::FilterCloudFused(typename pcl::PointCloud<PointT>::Ptr cloud, float filterRes, Eigen::Vector4f minPoint, Eigen::Vector4f maxPoint)
+{
+
+    // Time filtering process
+    static const StageMetrics stageMetrics("filter_fused");
+    StageTimer timer(stageMetrics);
+
+    // Region crop, roof removal and voxel averaging in one pass over the input
+    FusedVoxelFilter<PointT> fusedFilter(filterRes, minPoint, maxPoint, roofMinPoint, roofMaxPoint);
+    typename pcl::PointCloud<PointT>::Ptr cloudRegion(new pcl::PointCloud<PointT>);
+    fusedFilter.filter(*cloud, *cloudRegion);
+
+    const double elapsedMs = timer.stop(cloud->points.size(), cloudRegion->points.size());
+    metrics().log() << "fused filtering took " << elapsedMs << " milliseconds" << std::endl;
 
     return cloudRegion;
 
 }
 
 
+template<typename PointT>
+typename pcl::PointCloud<PointT>::Ptr ProcessPointClouds<PointT>::FilterCloudParallel(typename pcl::PointCloud<PointT>::Ptr cloud, float filterRes, Eigen::Vector4f minPoint, Eigen::Vector4f maxPoint)
+{
+
+    // Time filtering process
+    static const StageMetrics stageMetrics("filter_parallel");
+    StageTimer timer(stageMetrics);
+
+    // Same region and roof semantics as the fused filter, voxel reduction spread over numThreads
+    ParallelVoxelFilter<PointT> parallelFilter(filterRes, minPoint, maxPoint, roofMinPoint, roofMaxPoint, numThreads);
+    typename pcl::PointCloud<PointT>::Ptr cloudRegion(new pcl::PointCloud<PointT>);
+    parallelFilter.filter(*cloud, *cloudRegion);
+
+    const double elapsedMs = timer.stop(cloud->points.size(), cloudRegion->points.size());
+    metrics().log() << "parallel filtering on " << parallelFilter.numThreads << " threads took " << elapsedMs << " milliseconds" << std::endl;
+
+    return cloudRegion;
+
+}
+
+
+template<typename PointT>
+RangeImage<PointT> ProcessPointClouds<PointT>::ProjectRangeImage(typename pcl::PointCloud<PointT>::Ptr cloud, const RangeImageGeometry& geometry)
+{
+
+    // Time projection process
+    static const StageMetrics stageMetrics("range_image");
+    StageTimer timer(stageMetrics);
+
+    RangeImage<PointT> rangeImage(geometry);
+    rangeImage.project(cloud);
+
+    const double elapsedMs = timer.stop(cloud->points.size(), cloud->points.size() - rangeImage.droppedPoints);
+    metrics().log() << "range image projection took " << elapsedMs << " milliseconds, "
+              << rangeImage.droppedPoints << " of " << cloud->points.size() << " points dropped" << std::endl;
+
+    return rangeImage;
+
+}
+
+
 template<typename PointT>
 std::pair<typename pcl::PointCloud<PointT>::Ptr, typename pcl::PointCloud<PointT>::Ptr> ProcessPointClouds<PointT>::SeparateCloudsScratch(const std::unordered_set<int>& inliers, typename pcl::PointCloud<PointT>::Ptr cloud) 
 {
@@ -105,94 +221,166 @@ template<typename PointT>
 std::pair<typename pcl::PointCloud<PointT>::Ptr, typename pcl::PointCloud<PointT>::Ptr> ProcessPointClouds<PointT>::SegmentPlaneScratch(typename pcl::PointCloud<PointT>::Ptr cloud, int maxIterations, float distanceThreshold)
 {
     // Time segmentation process
-    auto startTime = std::chrono::steady_clock::now();
-	pcl::PointIndices::Ptr inliers{new pcl::PointIndices};
-    pcl::ModelCoefficients::Ptr coefficients{new pcl::ModelCoefficients};
+    static const StageMetrics stageMetrics("segment_scratch");
+    static const int iterationsMetric = metrics().id("segment_scratch.iterations", MetricUnit::Count);
+    StageTimer timer(stageMetrics);
+
+    // RANSAC implemention from scratch on the generic engine (segmentation/ransac.h)
+    // Hypotheses are scored by counting inliers over contiguous coordinate arrays, spread
+    // over numThreads each with its own seeded generator, and polished with least squares
+    // when refinement is on. The inlier set is only materialised once for the winning plane
+    PointArrays points(*cloud);
+    const int numPoints = points.size();
+
+    Eigen::Vector4f bestPlane = Eigen::Vector4f::Zero();
+    int iterations = 0;
+    int bestCount = ransacFit(points, PlaneModel(), distanceThreshold, maxIterations, ransacTargetConfidence, ransacRefinement, numThreads, ransacSeed, bestPlane, iterations);
+
+    lastRansacStats = RansacStats();
+    lastRansacStats.iterations = iterations;
+    lastRansacStats.maxIterations = maxIterations;
+    lastRansacStats.inliers = bestCount;
+    lastRansacStats.points = numPoints;
+    lastRansacStats.confidence = ransacConfidence(lastRansacStats.inlierRatio(), 3, iterations);
+    lastRansacStats.plane = bestPlane;
+
+    // Split the cloud once against the winning plane
+    std::pair<typename pcl::PointCloud<PointT>::Ptr, typename pcl::PointCloud<PointT>::Ptr> segResult = SeparateCloudsPlane(bestPlane, distanceThreshold, cloud);
+
+    const double elapsedMs = timer.stop(cloud->points.size(), segResult.first->points.size());
+    metrics().record(iterationsMetric, iterations);
+    metrics().log() << "plane segmentation took " << elapsedMs << " milliseconds, " << lastRansacStats.iterations << " iterations, "
+              << "inlier ratio " << lastRansacStats.inlierRatio() << ", confidence " << lastRansacStats.confidence << std::endl;
 
-    // TODO:: Fill in this function to find inliers for the cloud.
+    return segResult;
+}
 
-    // RANSAC implemention from scratch
-    std::unordered_set<int> inliersResult;
-	srand(time(NULL));
-	
-	// For max iterations 
-	while(maxIterations--){
-		std::unordered_set<int> inliers;
-
-		// Randomly sample subset and fit line
-		while(inliers.size() <  3){
-			inliers.insert(rand()% (cloud->points.size()));
-		}	
-
-		float x1, y1, z1, x2, y2, z2, x3, y3, z3;
-
-		auto itr = inliers.begin();
-		x1 = cloud->points[*itr].x;
-		y1 = cloud->points[*itr].y;
-		z1 = cloud->points[*itr].z;
-
-		itr++;
-
-		x2 = cloud->points[*itr].x;
-		y2 = cloud->points[*itr].y;
-		z2 = cloud->points[*itr].z;
-
-		itr++;
-		x3 = cloud->points[*itr].x;
-		y3 = cloud->points[*itr].y;
-		z3 = cloud->points[*itr].z;
-
-		// Fit plane : Ax + By + Cz + D = 0
-		// Use point1 as a reference and define two vectors on the plane v1 and v2
-		float v1x = x2 - x1;
-		float v1y = y2 - y1;
-		float v1z = z2 - z1;
-
-		float v2x = x3 - x1;
-		float v2y = y3 - y1;
-		float v2z = z3 - z1;
-
-		// Find normal vector to the plane by taking cross product of v1 \times v2:
-		float a = v1y * v2z - v1z * v2y;
-		float b = v1z * v2x - v1x * v2z;
-		float c = v1x * v2y - v1y * v2x;
-		float d = -( a*x1 + b*y1 + c*z1 );
-
-		for(int index = 0; index < cloud->points.size(); index ++){
-			// avoid inserting same index that is used fitting the plane
-			if(inliers.count(index)> 0){
-				continue;  
-			}
-
-			PointT point = cloud->points[index];
-			float x4 = point.x;
-			float y4 = point.y;
-			float z4 = point.z;
-
-			// Measure distance between every point and fitted line
-			float distance = fabs(a*x4 + b*y4 + c*z4 + d) / sqrt(a*a + b*b + c*c);
-			// If distance is smaller than threshold count it as inlier
-			if(distance <= distanceThreshold){
-				inliers.insert(index);
-			}
-
-		}
-		// Return indicies of inliers from fitted line with most inliers
-		if(inliers.size() > inliersResult.size()){
-			inliersResult = inliers;
-		}
-
-	}
-	
-    auto endTime = std::chrono::steady_clock::now();
-    auto elapsedTime = std::chrono::duration_cast<std::chrono::milliseconds>(endTime - startTime);
-    std::cout << "plane segmentation took " << elapsedTime.count() << " milliseconds" << std::endl;
-
-    std::pair<typename pcl::PointCloud<PointT>::Ptr, typename pcl::PointCloud<PointT>::Ptr> segResult = SeparateCloudsScratch(inliersResult, cloud);
-    
+
+template<typename PointT>
+std::pair<typename pcl::PointCloud<PointT>::Ptr, typename pcl::PointCloud<PointT>::Ptr> ProcessPointClouds<PointT>::SeparateCloudsPlane(const Eigen::Vector4f& plane, float distanceThreshold, typename pcl::PointCloud<PointT>::Ptr cloud)
+{
+    // Points within distanceThreshold of the unit normal plane go to the plane cloud
+    typename pcl::PointCloud<PointT>::Ptr obstCloud (new pcl::PointCloud<PointT>());
+    typename pcl::PointCloud<PointT>::Ptr planeCloud (new pcl::PointCloud<PointT>());
+    const bool validPlane = plane.head<3>().squaredNorm() > 0;
+
+    for (const PointT& point : cloud->points) {
+        if (validPlane && fabs(plane[0]*point.x + plane[1]*point.y + plane[2]*point.z + plane[3]) <= distanceThreshold)
+            planeCloud->points.push_back(point);
+        else
+            obstCloud->points.push_back(point);
+    }
+    obstCloud->width = obstCloud->points.size();
+    obstCloud->height = 1;
+    planeCloud->width = planeCloud->points.size();
+    planeCloud->height = 1;
+
+    std::pair<typename pcl::PointCloud<PointT>::Ptr, typename pcl::PointCloud<PointT>::Ptr> segResult(obstCloud, planeCloud);
     return segResult;
 }
 
+
+template<typename PointT>
+std::pair<typename pcl::PointCloud<PointT>::Ptr, typename pcl::PointCloud<PointT>::Ptr> ProcessPointClouds<PointT>::SegmentPlaneTracked(typename pcl::PointCloud<PointT>::Ptr cloud, int maxIterations, float distanceThreshold)
+{
+    // Time segmentation process, a frame that falls back to full RANSAC is also counted by SegmentPlaneScratch
+    static const StageMetrics stageMetrics("segment_tracked");
+    static const int reusedMetric = metrics().id("segment_tracked.reused", MetricUnit::Count);
+    StageTimer timer(stageMetrics);
+
+    // Try last frame's ground plane first, refit on this frame's points
+    if (trackedPlaneValid) {
+        PointArrays points(*cloud);
+        const int numPoints = points.size();
+        RansacScorer<PlaneModel> scorer(points, PlaneModel(), distanceThreshold);
+
+        Eigen::Vector4f plane = trackedPlane;
+        int count = scorer.optimize(plane, scorer.count(plane));
+        double inlierRatio = numPoints > 0 ? double(count) / numPoints : 0.0;
+
+        // Keep it unless the ground lost too much support compared to the last full RANSAC;
+        // the reference stays fixed while warm starting, so slow decay still falls back
+        if (count >= 3 && inlierRatio >= trackedPlaneRetention * trackedInlierRatio) {
+            trackedPlane = plane;
+
+            lastRansacStats = RansacStats();
+            lastRansacStats.maxIterations = maxIterations;
+            lastRansacStats.inliers = count;
+            lastRansacStats.points = numPoints;
+            lastRansacStats.confidence = 1.0;
+            lastRansacStats.plane = plane;
+            lastRansacStats.warmStart = true;
+
+            std::pair<typename pcl::PointCloud<PointT>::Ptr, typename pcl::PointCloud<PointT>::Ptr> segResult = SeparateCloudsPlane(plane, distanceThreshold, cloud);
+
+            const double elapsedMs = timer.stop(cloud->points.size(), segResult.first->points.size());
+            metrics().record(reusedMetric, 1);
+            metrics().log() << "plane segmentation reused last frame's plane, took " << elapsedMs << " milliseconds, "
+                      << "inlier ratio " << inlierRatio << std::endl;
+
+            return segResult;
+        }
+    }
+
+    // No plane yet or it no longer fits: full RANSAC, then track its result
+    std::pair<typename pcl::PointCloud<PointT>::Ptr, typename pcl::PointCloud<PointT>::Ptr> segResult = SegmentPlaneScratch(cloud, maxIterations, distanceThreshold);
+    trackedPlaneValid = lastRansacStats.inliers >= 3;
+    trackedPlane = lastRansacStats.plane;
+    trackedInlierRatio = lastRansacStats.inlierRatio();
+
+    timer.stop(cloud->points.size(), segResult.first->points.size());
+    metrics().record(reusedMetric, 0);
+
+    return segResult;
+}
+
+
+template<typename PointT>
+std::pair<typename pcl::PointCloud<PointT>::Ptr, typename pcl::PointCloud<PointT>::Ptr> ProcessPointClouds<PointT>::SegmentGroundPolar(typename pcl::PointCloud<PointT>::Ptr cloud, float distanceThreshold, const PolarGridParams& params)
+{
+    // Time segmentation process
+    static const StageMetrics stageMetrics("segment_polar");
+    StageTimer timer(stageMetrics);
+
+    PolarGridGround<PointT> polarGrid(params);
+    std::vector<bool> ground;
+    polarGrid.segment(*cloud, distanceThreshold, ground);
+
+    typename pcl::PointCloud<PointT>::Ptr obstCloud (new pcl::PointCloud<PointT>());
+    typename pcl::PointCloud<PointT>::Ptr groundCloud (new pcl::PointCloud<PointT>());
+    for (int index = 0; index < int(cloud->points.size()); ++index) {
+        if (ground[index])
+            groundCloud->points.push_back(cloud->points[index]);
+        else
+            obstCloud->points.push_back(cloud->points[index]);
+    }
+    obstCloud->width = obstCloud->points.size();
+    obstCloud->height = 1;
+    groundCloud->width = groundCloud->points.size();
+    groundCloud->height = 1;
+
+    const double elapsedMs = timer.stop(cloud->points.size(), obstCloud->points.size());
+    metrics().log() << "polar grid ground segmentation took " << elapsedMs << " milliseconds, "
+              << groundCloud->points.size() << " ground points" << std::endl;
+
+    std::pair<typename pcl::PointCloud<PointT>::Ptr, typename pcl::PointCloud<PointT>::Ptr> segResult(obstCloud, groundCloud);
+    return segResult;
+}
+
+
+template<typename PointT>
+void ProcessPointClouds<PointT>::setPlaneRetention(double retention)
+{
+    trackedPlaneRetention = retention;
+}
+
+
+template<typename PointT>
+void ProcessPointClouds<PointT>::resetPlaneTracking()
+{
+    trackedPlaneValid = false;
+}
+
 template<typename PointT>
 std::pair<typename pcl::PointCloud<PointT>::Ptr, typename pcl::PointCloud<PointT>::Ptr> ProcessPointClouds<PointT>::SeparateClouds(pcl::PointIndices::Ptr inliers, typename pcl::PointCloud<PointT>::Ptr cloud) 
 {
@@ -220,24 +408,42 @@ template<typename PointT>
 std::pair<typename pcl::PointCloud<PointT>::Ptr, typename pcl::PointCloud<PointT>::Ptr> ProcessPointClouds<PointT>::SegmentPlane(typename pcl::PointCloud<PointT>::Ptr cloud, int maxIterations, float distanceThreshold)
 {
     // Time segmentation process
-    auto startTime = std::chrono::steady_clock::now();
+    static const StageMetrics stageMetrics("segment_plane");
+    static const int iterationsMetric = metrics().id("segment_plane.iterations", MetricUnit::Count);
+    StageTimer timer(stageMetrics);
     
     // TODO:: Fill in this function to find inliers for the cloud.
     pcl::PointIndices::Ptr inliers {new pcl::PointIndices};
-    pcl::ModelCoefficients::Ptr coefficients {new pcl::ModelCoefficients};
-    // Create the segmentation object
-    pcl::SACSegmentation<PointT> seg;
-    // Optional
-    seg.setOptimizeCoefficients (true);
-    // Mandatory
-    seg.setModelType (pcl::SACMODEL_PLANE);
-    seg.setMethodType (pcl::SAC_RANSAC);
-    seg.setMaxIterations (maxIterations);
-
-    seg.setDistanceThreshold (distanceThreshold);
-
-    seg.setInputCloud (cloud);
-    seg.segment (*inliers, *coefficients);
+    // Same steps as pcl::SACSegmentation, run directly so the iteration count is visible
+    typename pcl::SampleConsensusModelPlane<PointT>::Ptr model (new pcl::SampleConsensusModelPlane<PointT> (cloud));
+    CountingRansac<PointT> ransac (model, distanceThreshold);
+    ransac.setMaxIterations (maxIterations);
+    // PCL's RANSAC always stops adaptively, 0 keeps its default confidence of 0.99
+    if (ransacTargetConfidence > 0)
+        ransac.setProbability (ransacTargetConfidence);
+
+    Eigen::VectorXf coefficients;
+    if (ransac.computeModel ()) {
+        ransac.getInliers (inliers->indices);
+        ransac.getModelCoefficients (coefficients);
+        // Least squares refit on the inliers, then reselect them
+        Eigen::VectorXf refined;
+        model->optimizeModelCoefficients (inliers->indices, coefficients, refined);
+        if (refined.size () == 4 && refined.allFinite ()) {
+            coefficients = refined;
+            model->selectWithinDistance (coefficients, distanceThreshold, inliers->indices);
+        }
+    }
+
+    lastRansacStats = RansacStats();
+    lastRansacStats.iterations = ransac.iterations ();
+    lastRansacStats.maxIterations = maxIterations;
+    lastRansacStats.inliers = inliers->indices.size ();
+    lastRansacStats.points = cloud->points.size ();
+    lastRansacStats.confidence = ransacConfidence (lastRansacStats.inlierRatio (), 3, lastRansacStats.iterations);
+    if (coefficients.size () == 4)
+        lastRansacStats.plane = coefficients;
+
     std::pair<typename pcl::PointCloud<PointT>::Ptr, typename pcl::PointCloud<PointT>::Ptr> segResult;
     if (inliers->indices.size () == 0){
         PCL_ERROR ("Could not estimate a planar model for the given dataset.\n");
@@ -245,40 +451,80 @@ std::pair<typename pcl::PointCloud<PointT>::Ptr, typename pcl::PointCloud<PointT
     }
     segResult = SeparateClouds(inliers,cloud);
     
-    auto endTime = std::chrono::steady_clock::now();
-    auto elapsedTime = std::chrono::duration_cast<std::chrono::milliseconds>(endTime - startTime);
-    std::cout << "plane segmentation took " << elapsedTime.count() << " milliseconds" << std::endl;
+    const double elapsedMs = timer.stop(cloud->points.size(), segResult.first->points.size());
+    metrics().record(iterationsMetric, lastRansacStats.iterations);
+    metrics().log() << "plane segmentation took " << elapsedMs << " milliseconds, " << lastRansacStats.iterations << " iterations, "
+              << "inlier ratio " << lastRansacStats.inlierRatio() << ", confidence " << lastRansacStats.confidence << std::endl;
 
     return segResult;
 }
 
 template<typename PointT>
-std::vector<typename pcl::PointCloud<PointT>::Ptr> ProcessPointClouds<PointT>::Clustering(typename pcl::PointCloud<PointT>::Ptr cloud, float clusterTolerance, int minSize, int maxSize)
+std::vector<typename pcl::PointCloud<PointT>::Ptr> ProcessPointClouds<PointT>::Clustering(typename pcl::PointCloud<PointT>::Ptr cloud, float clusterTolerance, int minSize, int maxSize, ClusterMethod method)
 {
 
     // Time clustering process
-    auto startTime = std::chrono::steady_clock::now();
+    static const StageMetrics stageMetrics("cluster");
+    static const int clustersMetric = metrics().id("cluster.clusters", MetricUnit::Count);
+    StageTimer timer(stageMetrics);
 
     std::vector<typename pcl::PointCloud<PointT>::Ptr> clusters;
+    std::vector<std::vector<int>> clusterIndices;
+
+    if (method == ClusterMethod::RangeImage) {
+        // no spatial index, neighbours come from the (ring, azimuth) window of every point
+        static const int outsideMetric = metrics().id("cluster.range_image.outside", MetricUnit::Count);
+        RangeImage<PointT> rangeImage(clusterImageGeometry);
+        rangeImage.project(cloud);
+        clusterIndices = rangeImageClusters(rangeImage, clusterTolerance, minSize, maxSize);
+
+        // points above or below the image's rings are in no cluster
+        const std::size_t outside = std::count(rangeImage.pointCells.begin(), rangeImage.pointCells.end(), -1);
+        metrics().record(outsideMetric, outside);
+        if (outside > 0)
+            metrics().log() << "range image clustering left out " << outside << " of " << cloud->points.size()
+                      << " points outside the image's elevation range" << std::endl;
+    }
+    else if (method == ClusterMethod::ParallelVoxelHash) {
+        // slabs clustered per thread, merged across slab borders with a concurrent union-find
+        clusterIndices = parallelVoxelHashClusters(*cloud, clusterTolerance, minSize, maxSize, numThreads);
+    }
+    else if (method == ClusterMethod::VoxelHash) {
+        // connected components over the 27 cells around every point
+        clusterIndices = voxelHashClusters(*cloud, clusterTolerance, minSize, maxSize);
+    }
+    else if (method == ClusterMethod::KdTree) {
+        // neighbour lists of all points as one batch over numThreads, then the graph walk
+        FlatKdTree<PointT> tree;
+        tree.setInputCloud(cloud);
+        tree.radiusSearchBatch(*cloud, clusterTolerance, clusterNeighbors, 0, numThreads);
+        clusterIndices = neighborListClusters(clusterNeighbors, minSize, maxSize);
+    }
+    else {
+        // TODO:: Fill in the function to perform euclidean clustering to group detected obstacles
+        // Creating the KdTree object for the search method of the extraction
+        typename pcl::search::KdTree<PointT>::Ptr tree (new pcl::search::KdTree<PointT>);
+        tree->setInputCloud (cloud);
+
+        std::vector<pcl::PointIndices> cluster_indices;
+        pcl::EuclideanClusterExtraction<PointT> ec;
+
+        ec.setClusterTolerance (clusterTolerance); // 2cm
+        ec.setMinClusterSize (minSize);
+        ec.setMaxClusterSize (maxSize);
+        ec.setSearchMethod (tree);
+        ec.setInputCloud (cloud);
+        ec.extract (cluster_indices);
+
+        for(pcl::PointIndices getIndices: cluster_indices)
+            clusterIndices.push_back(getIndices.indices);
+    }
 
-    // TODO:: Fill in the function to perform euclidean clustering to group detected obstacles
-    // Creating the KdTree object for the search method of the extraction
-    typename pcl::search::KdTree<PointT>::Ptr tree (new pcl::search::KdTree<PointT>);
-    tree->setInputCloud (cloud);
-
-    std::vector<pcl::PointIndices> cluster_indices;
-    pcl::EuclideanClusterExtraction<PointT> ec;
-
-    ec.setClusterTolerance (clusterTolerance); // 2cm
-    ec.setMinClusterSize (minSize);
-    ec.setMaxClusterSize (maxSize);
-    ec.setSearchMethod (tree);
-    ec.setInputCloud (cloud);
-    ec.extract (cluster_indices);
-
-    for(pcl::PointIndices getIndices: cluster_indices){
+    std::size_t clusteredPoints = 0;
+    for(const std::vector<int>& indices : clusterIndices){
        typename pcl::PointCloud<PointT>::Ptr cloudCluster (new pcl::PointCloud<PointT>); 
-       for(int index : getIndices.indices){
+       cloudCluster->points.reserve(indices.size());
+       for(int index : indices){
             cloudCluster->points.push_back(cloud->points[index]);
        }
        cloudCluster->width = cloudCluster->points.size();
@@ -286,11 +532,12 @@ std::vector<typename pcl::PointCloud<PointT>::Ptr> ProcessPointClouds<PointT>::C
        cloudCluster->is_dense = true;
 
        clusters.push_back(cloudCluster);
+       clusteredPoints += cloudCluster->points.size();
     }
 
-    auto endTime = std::chrono::steady_clock::now();
-    auto elapsedTime = std::chrono::duration_cast<std::chrono::milliseconds>(endTime - startTime);
-    std::cout << "clustering took " << elapsedTime.count() << " milliseconds and found " << clusters.size() << " clusters" << std::endl;
+    const double elapsedMs = timer.stop(cloud->points.size(), clusteredPoints);
+    metrics().record(clustersMetric, clusters.size());
+    metrics().log() << "clustering took " << elapsedMs << " milliseconds and found " << clusters.size() << " clusters" << std::endl;
 
     return clusters;
 }
@@ -363,15 +610,56 @@ BoxQ ProcessPointClouds<PointT>::BoundingBoxPCA(typename pcl::PointCloud<PointT>
      
 
     return boxQ;
-   
+
     }
 
 
+template<typename PointT>
+BoxQ ProcessPointClouds<PointT>::BoundingBoxFootprint(typename pcl::PointCloud<PointT>::Ptr cluster, FootprintFit fit)
+{
+    return footprintBox(*cluster, fit);
+}
+
+
+template<typename PointT>
+ClusterFeatureList ProcessPointClouds<PointT>::BoundingBoxes(const std::vector<typename pcl::PointCloud<PointT>::Ptr>& clusters)
+{
+    static const StageMetrics stageMetrics("bounding_boxes");
+    static const int clustersMetric = metrics().id("bounding_boxes.clusters", MetricUnit::Count);
+    StageTimer timer(stageMetrics);
+
+    ClusterFeatureList features;
+    clusterFeaturesBatch<PointT>(clusters, features, numThreads);
+
+    const double elapsedMs = timer.stop();
+    metrics().record(clustersMetric, clusters.size());
+    metrics().log() << "bounding boxes took " << elapsedMs << " milliseconds for " << clusters.size() << " clusters" << std::endl;
+
+    return features;
+}
+
+
 template<typename PointT>
 void ProcessPointClouds<PointT>::savePcd(typename pcl::PointCloud<PointT>::Ptr cloud, std::string file)
 {
-    pcl::io::savePCDFileASCII (file, *cloud);
-    std::cerr << "Saved " << cloud->points.size () << " data points to "+file << std::endl;
+    if (isPointCodecFile(file))
+    {
+        if (!savePointCodecFile(file, *cloud, pointCodecParams))
+        {
+            std::cerr << "Couldn't encode " << cloud->points.size () << " data points to "+file << std::endl;
+            return;
+        }
+    }
+    else
+        pcl::io::savePCDFileBinary (file, *cloud);
+    metrics().log() << "Saved " << cloud->points.size () << " data points to "+file << std::endl;
+}
+
+
+template<typename PointT>
+void ProcessPointClouds<PointT>::setPointCodec(const PointCodecParams& params)
+{
+    pointCodecParams = params;
 }
 
 
@@ -381,16 +669,32 @@ typename pcl::PointCloud<PointT>::Ptr ProcessPointClouds<PointT>::loadPcd(std::s
 
     typename pcl::PointCloud<PointT>::Ptr cloud (new pcl::PointCloud<PointT>);
 
-    if (pcl::io::loadPCDFile<PointT> (file, *cloud) == -1) //* load the file
+    // binary frames are copied straight out of the mapped file
+    MappedPcd mapped;
+    if (isPointCodecFile(file))
+    {
+        if (!loadPointCodecFile(file, *cloud))
+            PCL_ERROR ("Couldn't decode file \n");
+    }
+    else if (mapped.open(file))
+        mapped.copyTo(*cloud);
+    else if (pcl::io::loadPCDFile<PointT> (file, *cloud) == -1) //* load the file
     {
         PCL_ERROR ("Couldn't read file \n");
     }
-    std::cerr << "Loaded " << cloud->points.size () << " data points from "+file << std::endl;
+    metrics().log() << "Loaded " << cloud->points.size () << " data points from "+file << std::endl;
 
     return cloud;
 }
 
 
+template<typename PointT>
+void ProcessPointClouds<PointT>::prefetchPcd(const std::string& file)
+{
+    MappedFile::prefetch(file);
+}
+
+
 template<typename PointT>
 std::vector<boost::filesystem::path> ProcessPointClouds<PointT>::streamPcd(std::string dataPath)
 {
@@ -402,4 +706,34 @@ std::vector<boost::filesystem::path> ProcessPointClouds<PointT>::streamPcd(std::
 
     return paths;
 
-}
\ No newline at end of file
+}
+
+
+template<typename PointT>
+FrameStream<PointT> ProcessPointClouds<PointT>::streamFrames(std::string dataPath)
+{
+
+    FrameStream<PointT> stream;
+    if (!stream.open(dataPath))
+        std::cerr << dataPath << " is neither a pcd directory nor a replay archive" << std::endl;
+
+    return stream;
+
+}
+
+
+template<typename PointT>
+typename pcl::PointCloud<PointT>::Ptr ProcessPointClouds<PointT>::loadFrame(const FrameStream<PointT>& stream, std::size_t frame)
+{
+
+    typename pcl::PointCloud<PointT>::Ptr cloud (new pcl::PointCloud<PointT>);
+
+    if (!stream.load(frame, *cloud))
+    {
+        PCL_ERROR ("Couldn't read file \n");
+    }
+    metrics().log() << "Loaded " << cloud->points.size () << " data points from "+stream.name(frame) << std::endl;
+
+    return cloud;
+
+}
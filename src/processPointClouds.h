@@ -11,6 +11,8 @@
 #include <pcl/filters/crop_box.h>
 #include <pcl/kdtree/kdtree.h>
 #include <pcl/segmentation/sac_segmentation.h>
+#include <pcl/sample_consensus/ransac.h>
+#include <pcl/sample_consensus/sac_model_plane.h>
 #include <pcl/segmentation/extract_clusters.h>
 #include <pcl/common/transforms.h>
 #include <Eigen/Dense>
@@ -21,7 +23,56 @@
 #include <limits>
 #include <ctime>
 #include <chrono>
+#include <random>
 #include "render/box.h"
+#include "common/metrics.h"
+#include "filters/voxelFilter.h"
+#include "sensors/rangeImage.h"
+#include "segmentation/ransacModels.h"
+#include "segmentation/polarGridGround.h"
+#include "clustering/euclideanClusters.h"
+#include "clustering/voxelHashClusters.h"
+#include "clustering/rangeImageClusters.h"
+#include "clustering/clusterFeatures.h"
+#include "clustering/footprintBox.h"
+#include "io/mappedPcd.h"
+#include "io/pointCodec.h"
+#include "io/frameStream.h"
+#include "io/frameRecorder.h"
+
+// Selects the implementation FilterCloud runs
+enum class FilterMethod
+{
+    PCL,        // pcl::VoxelGrid followed by region and roof CropBox passes
+    Fused,      // single pass hashed voxel map, see filters/voxelFilter.h
+    Parallel    // multi-threaded voxel key radix sort, see filters/voxelFilter.h; runs on setNumThreads
+                // threads, which is 1 unless the caller raises it
+};
+
+// Selects the implementation Clustering runs. All but RangeImage give the same partition
+// (benchmark checks it), but PCL lists clusters by descending size and the others by
+// their lowest point index, so render colours and box ids change with the method.
+enum class ClusterMethod
+{
+    PCL,        // pcl::EuclideanClusterExtraction on a pcl::search::KdTree
+    KdTree,     // batched radius searches on the flat k-d tree, then worklist growth, see clustering/euclideanClusters.h
+    VoxelHash,  // union-find over tolerance sized hashed cells, see clustering/voxelHashClusters.h
+    ParallelVoxelHash, // VoxelHash with the grid built and split into spatial slabs over numThreads, identical result
+    RangeImage  // (ring, azimuth) neighbours in a range image, see clustering/rangeImageClusters.h;
+                // matches the others only for points inside setClusterImageGeometry's
+                // elevation range, points outside it are left out of every cluster
+};
+
+// pcl::RandomSampleConsensus that reports how many hypotheses it drew
+template<typename PointT>
+class CountingRansac : public pcl::RandomSampleConsensus<PointT>
+{
+public:
+    CountingRansac(const typename pcl::SampleConsensusModel<PointT>::Ptr& model, double threshold)
+        : pcl::RandomSampleConsensus<PointT>(model, threshold) {}
+
+    int iterations() const { return this->iterations_; }
+};
 
 template<typename PointT>
 class ProcessPointClouds {
@@ -32,9 +83,39 @@ public:
     //deconstructor
     ~ProcessPointClouds();
 
+    // worker threads used by the multi-threaded stages (parallel filter, SegmentPlaneScratch),
+    // 1 by default, 0 uses every hardware thread
+    void setNumThreads(int threads);
+
+    // RANSAC stopping rule: 0 draws maxIterations hypotheses in SegmentPlaneScratch (PCL's
+    // default of 0.99 in SegmentPlane), a value in (0, 1) stops once an outlier free
+    // sample was drawn with that probability given the best inlier ratio so far
+    void setRansacConfidence(double confidence);
+
+    // least squares refit of every new best plane and of the final plane in SegmentPlaneScratch
+    void setRansacRefinement(bool refine);
+
+    // seed of the per thread generators in SegmentPlaneScratch, random by default; a fixed
+    // seed and thread count reproduce the same plane
+    void setRansacSeed(unsigned seed);
+
+    // iterations, inliers and confidence of the last SegmentPlane, SegmentPlaneScratch or SegmentPlaneTracked call
+    const RansacStats& getRansacStats() const;
+
     void numPoints(typename pcl::PointCloud<PointT>::Ptr cloud);
 
-    typename pcl::PointCloud<PointT>::Ptr FilterCloud(typename pcl::PointCloud<PointT>::Ptr cloud, float filterRes, Eigen::Vector4f minPoint, Eigen::Vector4f maxPoint);
+    typename pcl::PointCloud<PointT>::Ptr FilterCloud(typename pcl::PointCloud<PointT>::Ptr cloud, float filterRes, Eigen::Vector4f minPoint, Eigen::Vector4f maxPoint, FilterMethod method = FilterMethod::PCL);
+
+    typename pcl::PointCloud<PointT>::Ptr FilterCloudFused(typename pcl::PointCloud<PointT>::Ptr cloud, float filterRes, Eigen::Vector4f minPoint, Eigen::Vector4f maxPoint);
+
+    typename pcl::PointCloud<PointT>::Ptr FilterCloudParallel(typename pcl::PointCloud<PointT>::Ptr cloud, float filterRes, Eigen::Vector4f minPoint, Eigen::Vector4f maxPoint);
+
+    RangeImage<PointT> ProjectRangeImage(typename pcl::PointCloud<PointT>::Ptr cloud, const RangeImageGeometry& geometry);
+
+    // image ClusterMethod::RangeImage projects into; by default 32 rings from -25 to 6
+    // degrees by 512 columns about the origin, covering the data_1 and data_2 scans and
+    // coarse enough for voxel filtered clouds to fill most cells near the car
+    void setClusterImageGeometry(const RangeImageGeometry& geometry);
 
     std::pair<typename pcl::PointCloud<PointT>::Ptr, typename pcl::PointCloud<PointT>::Ptr> SeparateClouds(pcl::PointIndices::Ptr inliers, typename pcl::PointCloud<PointT>::Ptr cloud);
 
@@ -44,17 +125,78 @@ public:
 
     std::pair<typename pcl::PointCloud<PointT>::Ptr, typename pcl::PointCloud<PointT>::Ptr> SegmentPlane(typename pcl::PointCloud<PointT>::Ptr cloud, int maxIterations, float distanceThreshold);
 
-    std::vector<typename pcl::PointCloud<PointT>::Ptr> Clustering(typename pcl::PointCloud<PointT>::Ptr cloud, float clusterTolerance, int minSize, int maxSize);
+    std::pair<typename pcl::PointCloud<PointT>::Ptr, typename pcl::PointCloud<PointT>::Ptr> SeparateCloudsPlane(const Eigen::Vector4f& plane, float distanceThreshold, typename pcl::PointCloud<PointT>::Ptr cloud);
+
+    // Stateful ground segmentation for streamed frames: starts from the previous frame's
+    // plane and only runs SegmentPlaneScratch when that plane keeps less than the
+    // retention fraction of the inlier ratio the last full RANSAC found
+    std::pair<typename pcl::PointCloud<PointT>::Ptr, typename pcl::PointCloud<PointT>::Ptr> SegmentPlaneTracked(typename pcl::PointCloud<PointT>::Ptr cloud, int maxIterations, float distanceThreshold);
+
+    // Ground removal without a global plane: per sector ground lines on a polar grid,
+    // follows sloped and curving roads, returns (obstacles, ground) like SegmentPlane
+    std::pair<typename pcl::PointCloud<PointT>::Ptr, typename pcl::PointCloud<PointT>::Ptr> SegmentGroundPolar(typename pcl::PointCloud<PointT>::Ptr cloud, float distanceThreshold, const PolarGridParams& params = PolarGridParams());
+
+    // fraction of the last full RANSAC's inlier ratio a carried over plane must keep, 0.9 by default
+    void setPlaneRetention(double retention);
+
+    // forget the tracked plane, e.g. when the stream jumps
+    void resetPlaneTracking();
+
+    std::vector<typename pcl::PointCloud<PointT>::Ptr> Clustering(typename pcl::PointCloud<PointT>::Ptr cloud, float clusterTolerance, int minSize, int maxSize, ClusterMethod method = ClusterMethod::PCL);
 
     Box BoundingBox(typename pcl::PointCloud<PointT>::Ptr cluster);
 
     BoxQ BoundingBoxPCA(typename pcl::PointCloud<PointT>::Ptr cluster);
 
+    // Yaw only box around a rectangle fitted to the cluster's xy footprint on its convex
+    // hull, height from z; does not tilt like BoundingBoxPCA, see clustering/footprintBox.h.
+    // Closeness by default, the steadiest yaw over data_1 but O(n h) for h hull vertices
+    // rather than MinArea's O(n log n)
+    BoxQ BoundingBoxFootprint(typename pcl::PointCloud<PointT>::Ptr cluster, FootprintFit fit = FootprintFit::Closeness);
+
+    // BoundingBox and BoundingBoxPCA of every cluster, plus centroid and covariance, in two
+    // passes per cluster without copies, clusters spread over numThreads
+    ClusterFeatureList BoundingBoxes(const std::vector<typename pcl::PointCloud<PointT>::Ptr>& clusters);
+
+    // .pcq files are written with the quantizing codec of io/pointCodec.h, anything else as
+    // binary PCD; blocks until written, io/frameRecorder.h records from a background thread
     void savePcd(typename pcl::PointCloud<PointT>::Ptr cloud, std::string file);
 
+    // precision and intensity bits savePcd uses for .pcq files, 1 mm and 8 bits by default
+    void setPointCodec(const PointCodecParams& params);
+
+    // .pcq files are decoded by io/pointCodec.h, binary PCDs with float x, y, z are read
+    // through a memory mapping, anything else by PCL
     typename pcl::PointCloud<PointT>::Ptr loadPcd(std::string file);
 
+    // start reading a file that loadPcd will be asked for soon, e.g. the next one from streamPcd
+    void prefetchPcd(const std::string& file);
+
     std::vector<boost::filesystem::path> streamPcd(std::string dataPath);
+
+    // frames of a pcd directory or of a replay archive (see io/replayArchive.h), in playback order
+    FrameStream<PointT> streamFrames(std::string dataPath);
+
+    typename pcl::PointCloud<PointT>::Ptr loadFrame(const FrameStream<PointT>& stream, std::size_t frame);
+
+private:
+
+    int numThreads;
+    double ransacTargetConfidence;
+    bool ransacRefinement;
+    unsigned ransacSeed;
+    RansacStats lastRansacStats;
+    bool trackedPlaneValid;
+    Eigen::Vector4f trackedPlane;
+    double trackedInlierRatio;
+    double trackedPlaneRetention;
+    RangeImageGeometry clusterImageGeometry;
+    PointCodecParams pointCodecParams;
+    // reused between frames by ClusterMethod::KdTree
+    NeighborLists clusterNeighbors;
+
+public:
+    EIGEN_MAKE_ALIGNED_OPERATOR_NEW
   
 };
 #endif /* PROCESSPOINTCLOUDS_H_ */
\ No newline at end of file
@@ -6,6 +6,8 @@
 #include <chrono>
 #include <string>
 #include "kdtree.h"
+#include "../../clustering/euclideanClusters.h"
+#include "../../common/metrics.h"
 
 // Arguments:
 // window is the region to draw box around
@@ -44,76 +46,42 @@ pcl::PointCloud<pcl::PointXYZ>::Ptr CreateData(std::vector<std::vector<float>> p
 }
 
 
-void render2DTree(Node* node, pcl::visualization::PCLVisualizer::Ptr& viewer, Box window, int& iteration, uint depth=0)
+// Draws the split lines of the flat tree, nodes are stored depth first with the left
+// child right after its parent
+void render2DTree(const KdTree& tree, int nodeIndex, pcl::visualization::PCLVisualizer::Ptr& viewer, Box window, int& iteration)
 {
-
-	if(node!=NULL)
+	const std::vector<KdTree::Node>& nodes = tree.getNodes();
+	if(nodeIndex >= int(nodes.size()) || nodes[nodeIndex].axis < 0)
+		return;
+
+	const KdTree::Node& node = nodes[nodeIndex];
+	Box upperWindow = window;
+	Box lowerWindow = window;
+	// split on x axis
+	if(node.axis == 0)
 	{
-		Box upperWindow = window;
-		Box lowerWindow = window;
-		// split on x axis
-		if(depth%2==0)
-		{
-			viewer->addLine(pcl::PointXYZ(node->point[0], window.y_min, 0),pcl::PointXYZ(node->point[0], window.y_max, 0),0,0,1,"line"+std::to_string(iteration));
-			lowerWindow.x_max = node->point[0];
-			upperWindow.x_min = node->point[0];
-		}
-		// split on y axis
-		else
-		{
-			viewer->addLine(pcl::PointXYZ(window.x_min, node->point[1], 0),pcl::PointXYZ(window.x_max, node->point[1], 0),1,0,0,"line"+std::to_string(iteration));
-			lowerWindow.y_max = node->point[1];
-			upperWindow.y_min = node->point[1];
-		}
-		iteration++;
-
-		render2DTree(node->left,viewer, lowerWindow, iteration, depth+1);
-		render2DTree(node->right,viewer, upperWindow, iteration, depth+1);
-
-
+		viewer->addLine(pcl::PointXYZ(node.split, window.y_min, 0),pcl::PointXYZ(node.split, window.y_max, 0),0,0,1,"line"+std::to_string(iteration));
+		lowerWindow.x_max = node.split;
+		upperWindow.x_min = node.split;
 	}
-
-}
-
-void proximity(int indice, const std::vector<std::vector<float>> points, std::vector<int>& cluster, std::vector<bool>& processedPoints, KdTree* tree, float distanceTol){
-	
-	processedPoints[indice] = true;
-	cluster.push_back(indice);
-
-	std::vector<int> nearestPointsIndices = tree->search(points[indice], distanceTol);	
-	for(int id:nearestPointsIndices){
-		if(!processedPoints[id]){
-			proximity(id, points, cluster, processedPoints, tree, distanceTol);
-		}
-
+	// split on y axis
+	else
+	{
+		viewer->addLine(pcl::PointXYZ(window.x_min, node.split, 0),pcl::PointXYZ(window.x_max, node.split, 0),1,0,0,"line"+std::to_string(iteration));
+		lowerWindow.y_max = node.split;
+		upperWindow.y_min = node.split;
 	}
-	std::cout << "clustering found " << cluster.size() << std::endl;
+	iteration++;
+
+	render2DTree(tree, nodeIndex + 1, viewer, lowerWindow, iteration);
+	render2DTree(tree, node.right, viewer, upperWindow, iteration);
 }
 
-std::vector<std::vector<int>> euclideanCluster(const std::vector<std::vector<float>>& points, KdTree* tree, float distanceTol)
+// Clusters are grown from an explicit worklist (clustering/euclideanClusters.h), so a
+// large cluster needs neither one stack frame per point nor copies of the data
+std::vector<std::vector<int>> euclideanCluster(const pcl::PointCloud<pcl::PointXYZ>& cloud, const KdTree& tree, float distanceTol)
 {
-
-	// TODO: Fill out this function to return list of indices for each cluster
-
-	std::vector<std::vector<int>> clusters;
-
-	std::vector<bool>processedPoints(points.size(), false); 
-    
-	int i = 0;
-
-	while(i < points.size()){
-		if(processedPoints[i]){
-			i++;
-			continue;
-		}
-
-		std::vector<int> cluster;
-		proximity(i, points, cluster, processedPoints, tree, distanceTol);
-		clusters.push_back(cluster);
-		i++;
-	}
-	return clusters;
-
+	return euclideanClusters(cloud, tree, distanceTol);
 }
 
 int main ()
@@ -134,28 +102,29 @@ int main ()
 	//std::vector<std::vector<float>> points = { {-6.2,7}, {-6.3,8.4}, {-5.2,7.1}, {-5.7,6.3} };
 	pcl::PointCloud<pcl::PointXYZ>::Ptr cloud = CreateData(points);
 
-	KdTree* tree = new KdTree;
-  
-    for (int i=0; i<points.size(); i++) 
-    	tree->insert(points[i],i); 
+	// bulk build, balanced whatever the insertion order; one point per leaf so every
+	// split gets drawn
+	KdTree tree(1);
+	tree.setInputCloud(cloud);
 
   	int it = 0;
-  	render2DTree(tree->root,viewer,window, it);
+  	render2DTree(tree, 0, viewer, window, it);
   
   	std::cout << "Test Search" << std::endl;
-  	std::vector<int> nearby = tree->search({-6,7},3.0);
+  	std::vector<int> nearby;
+  	tree.radiusSearch(-6, 7, 0, 3.0, nearby);
   	for(int index : nearby)
       std::cout << index << ",";
   	std::cout << std::endl;
 
   	// Time segmentation process
-  	auto startTime = std::chrono::steady_clock::now();
+  	static const StageMetrics stageMetrics("quiz_cluster");
+  	StageTimer timer(stageMetrics);
   	//
-  	std::vector<std::vector<int>> clusters = euclideanCluster(points, tree, 3.0);
+  	std::vector<std::vector<int>> clusters = euclideanCluster(*cloud, tree, 3.0);
   	//
-  	auto endTime = std::chrono::steady_clock::now();
-  	auto elapsedTime = std::chrono::duration_cast<std::chrono::milliseconds>(endTime - startTime);
-  	std::cout << "clustering found " << clusters.size() << " and took " << elapsedTime.count() << " milliseconds" << std::endl;
+  	const double elapsedMs = timer.stop();
+  	metrics().log() << "clustering found " << clusters.size() << " and took " << elapsedMs << " milliseconds" << std::endl;
 
   	// Render clusters
   	int clusterId = 0;
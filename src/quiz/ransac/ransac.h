@@ -0,0 +1,47 @@
+/* \author Aaron Brown */
+// Quiz on implementing simple RANSAC line and plane fitting
+
+#ifndef QUIZ_RANSAC_H
+#define QUIZ_RANSAC_H
+
+#include <pcl/common/common.h>
+#include <unordered_set>
+#include <random>
+#include "../../segmentation/ransacModels.h"
+
+// Both fits run on the generic RANSAC engine (segmentation/ransac.h): hypotheses are
+// spread over numThreads tasks of the shared thread pool, each drawing from its own
+// generator seeded with (seed, task), so a given seed and thread count always give the
+// same inliers
+template<typename Model>
+std::unordered_set<int> RansacInliers(pcl::PointCloud<pcl::PointXYZ>::Ptr cloud, const Model& model, int maxIterations, float distanceTol, int numThreads, unsigned seed)
+{
+	std::unordered_set<int> inliersResult;
+	PointArrays points(*cloud);
+
+	// Return indicies of inliers from fitted model with most inliers
+	typename Model::Coefficients best;
+	int iterations = 0;
+	if(ransacFit(points, model, distanceTol, maxIterations, 0.0, false, numThreads, seed, best, iterations) == 0)
+		return inliersResult;
+
+	RansacScorer<Model> scorer(points, model, distanceTol);
+	for(int index = 0; index < points.size(); index++)
+		if(scorer.inlier(best, index))
+			inliersResult.insert(index);
+	return inliersResult;
+}
+
+// Line equation ax + by + c = 0 with unit normal (a, b)
+inline std::unordered_set<int> RansacLine(pcl::PointCloud<pcl::PointXYZ>::Ptr cloud, int maxIterations, float distanceTol, int numThreads = 1, unsigned seed = std::random_device{}())
+{
+	return RansacInliers(cloud, LineModel(), maxIterations, distanceTol, numThreads, seed);
+}
+
+// Plane equation Ax + By + Cz + D = 0 with unit normal (A, B, C)
+inline std::unordered_set<int> RansacPlane(pcl::PointCloud<pcl::PointXYZ>::Ptr cloud, int maxIterations, float distanceTol, int numThreads = 1, unsigned seed = std::random_device{}())
+{
+	return RansacInliers(cloud, PlaneModel(), maxIterations, distanceTol, numThreads, seed);
+}
+
+#endif /* QUIZ_RANSAC_H */
@@ -0,0 +1,381 @@
+// Balanced 3D k-d tree stored in flat arrays, for radius and k nearest searches on point clouds
+
+#ifndef FLATKDTREE_H
+#define FLATKDTREE_H
+
+#include <pcl/common/common.h>
+#include <vector>
+#include <algorithm>
+#include <cmath>
+#include "../common/parallel.h"
+
+// Results of a batch of queries in CSR form: the neighbours of query q are
+// indices[offsets[q]] .. indices[offsets[q + 1] - 1]. Buffers are kept between calls,
+// so a reused NeighborLists stops allocating once it has seen the largest batch.
+struct NeighborLists
+{
+	std::vector<int> offsets;
+	std::vector<int> indices;
+	// squared distances matching indices, only filled by k nearest searches
+	std::vector<float> distances;
+
+	// per thread staging of a batch, reused between calls
+	std::vector<std::vector<int>> chunkIndices;
+	std::vector<std::vector<float>> chunkDistances;
+
+	int size() const { return offsets.empty() ? 0 : int(offsets.size()) - 1; }
+	int count(int query) const { return offsets[query + 1] - offsets[query]; }
+	const int* begin(int query) const { return indices.data() + offsets[query]; }
+	const int* end(int query) const { return indices.data() + offsets[query + 1]; }
+};
+
+// Built in one pass by median splits on the axis of largest extent, so it is balanced
+// whatever the point order. Nodes live in one vector in depth first order (the left child
+// follows its parent), and points are copied once into x, y, z arrays in tree order so
+// every leaf bucket is a contiguous run. Searches walk the nodes with a small fixed stack.
+// Single queries write into caller buffers; batches of queries return CSR NeighborLists
+// and can run on several threads.
+template<typename PointT>
+class FlatKdTree
+{
+public:
+	struct Node
+	{
+		int axis;       // split axis 0, 1, 2 or -1 for a leaf
+		float split;    // left subtree has coordinates <= split, right subtree >= split
+		int right;      // index of the right child, the left child is the next node
+		int begin, end; // range of the subtree's points in tree order
+	};
+
+	FlatKdTree(int setLeafSize = 16)
+		: leafSize(std::max(1, setLeafSize))
+	{}
+
+	// Builds the tree over all finite points of cloud, O(n log n)
+	void setInputCloud(const typename pcl::PointCloud<PointT>::ConstPtr& cloud)
+	{
+		const int numPoints = cloud->points.size();
+		order.clear();
+		order.reserve(numPoints);
+		for(int index = 0; index < numPoints; ++index)
+		{
+			const PointT& point = cloud->points[index];
+			if(std::isfinite(point.x) && std::isfinite(point.y) && std::isfinite(point.z))
+				order.push_back(index);
+		}
+
+		// coordinates by original index while partitioning
+		for(int axis = 0; axis < 3; ++axis)
+			coords[axis].resize(numPoints);
+		for(int index : order)
+		{
+			coords[0][index] = cloud->points[index].x;
+			coords[1][index] = cloud->points[index].y;
+			coords[2][index] = cloud->points[index].z;
+		}
+
+		nodes.clear();
+		if(!order.empty())
+		{
+			nodes.reserve(2 * (order.size() / leafSize + 1));
+			buildNode(0, order.size());
+		}
+
+		// then in tree order, so leaf scans read consecutive memory
+		std::vector<float> sorted(order.size());
+		for(int axis = 0; axis < 3; ++axis)
+		{
+			for(std::size_t position = 0; position < order.size(); ++position)
+				sorted[position] = coords[axis][order[position]];
+			coords[axis].swap(sorted);
+			sorted.resize(order.size());
+		}
+	}
+
+	// Indices of all points within radius of (x, y, z), in no particular order
+	int radiusSearch(float x, float y, float z, float radius, std::vector<int>& indices) const
+	{
+		indices.clear();
+		visitRadius(x, y, z, radius, [&indices](int index) { indices.push_back(index); return true; });
+		return indices.size();
+	}
+
+	int radiusSearch(const PointT& point, float radius, std::vector<int>& indices) const
+	{
+		return radiusSearch(point.x, point.y, point.z, radius, indices);
+	}
+
+	// The k points nearest to (x, y, z), closest first, written to indices and their
+	// squared distances to distances2, both with room for k. Returns how many were found,
+	// fewer than k only when the tree holds fewer points.
+	int nearestKSearch(float x, float y, float z, int k, int* indices, float* distances2) const
+	{
+		if(nodes.empty() || k <= 0)
+			return 0;
+
+		const float query[3] = {x, y, z};
+		const float* xs = coords[0].data();
+		const float* ys = coords[1].data();
+		const float* zs = coords[2].data();
+
+		// max heap on distance in the output arrays while searching
+		int found = 0;
+		struct Pending { int node; float bound2; };
+		Pending stack[64];
+		int top = 0;
+		stack[top++] = Pending{0, 0.f};
+		while(top > 0)
+		{
+			const Pending pending = stack[--top];
+			if(found == k && pending.bound2 > distances2[0])
+				continue;
+			const Node& node = nodes[pending.node];
+			if(node.axis < 0)
+			{
+				for(int position = node.begin; position < node.end; ++position)
+				{
+					const float dx = xs[position] - x, dy = ys[position] - y, dz = zs[position] - z;
+					const float distance2 = dx*dx + dy*dy + dz*dz;
+					if(found < k)
+						heapPush(indices, distances2, found++, order[position], distance2);
+					else if(distance2 < distances2[0])
+						heapReplaceTop(indices, distances2, found, order[position], distance2);
+				}
+				continue;
+			}
+
+			const float offset = query[node.axis] - node.split;
+			const int nearChild = offset <= 0 ? pending.node + 1 : node.right;
+			const int farChild = offset <= 0 ? node.right : pending.node + 1;
+			stack[top++] = Pending{farChild, std::max(pending.bound2, offset * offset)};
+			stack[top++] = Pending{nearChild, pending.bound2};
+		}
+
+		// heap sort into ascending distance
+		for(int size = found; size > 1; --size)
+		{
+			std::swap(indices[0], indices[size - 1]);
+			std::swap(distances2[0], distances2[size - 1]);
+			heapSiftDown(indices, distances2, 0, size - 1);
+		}
+		return found;
+	}
+
+	// Radius search for every point of queries into result. With maxResults > 0 a query
+	// stops after that many neighbours, which are then not necessarily the nearest.
+	// Queries are split over numThreads (0 for all hardware threads) on the shared pool.
+	void radiusSearchBatch(const pcl::PointCloud<PointT>& queries, float radius, NeighborLists& result, int maxResults = 0, int numThreads = 1) const
+	{
+		const std::size_t limit = maxResults > 0 ? std::size_t(maxResults) : std::size_t(-1);
+		runBatch(queries, result, false, numThreads, [&](const PointT& query, std::vector<int>& indices, std::vector<float>&)
+		{
+			const std::size_t first = indices.size();
+			visitRadius(query.x, query.y, query.z, radius, [&](int index)
+			{
+				indices.push_back(index);
+				return indices.size() - first < limit;
+			});
+			return int(indices.size() - first);
+		});
+	}
+
+	// k nearest neighbours of every point of queries, closest first, with squared
+	// distances in result.distances. A query point that is in the tree finds itself.
+	void nearestKSearchBatch(const pcl::PointCloud<PointT>& queries, int k, NeighborLists& result, int numThreads = 1) const
+	{
+		runBatch(queries, result, true, numThreads, [&](const PointT& query, std::vector<int>& indices, std::vector<float>& distances)
+		{
+			const std::size_t first = indices.size();
+			indices.resize(first + k);
+			distances.resize(first + k);
+			const int found = nearestKSearch(query.x, query.y, query.z, k, &indices[first], &distances[first]);
+			indices.resize(first + found);
+			distances.resize(first + found);
+			return found;
+		});
+	}
+
+	const std::vector<Node>& getNodes() const { return nodes; }
+	int size() const { return order.size(); }
+
+private:
+	// Calls visit(index) for every point within radius, stops early when visit returns false
+	template<typename Visit>
+	void visitRadius(float x, float y, float z, float radius, Visit visit) const
+	{
+		if(nodes.empty())
+			return;
+
+		const float query[3] = {x, y, z};
+		const float radius2 = radius * radius;
+		const float* xs = coords[0].data();
+		const float* ys = coords[1].data();
+		const float* zs = coords[2].data();
+
+		// depth is at most log2(n / leafSize) + 1 since every split halves its range
+		int stack[64];
+		int top = 0;
+		stack[top++] = 0;
+		while(top > 0)
+		{
+			const int nodeIndex = stack[--top];
+			const Node& node = nodes[nodeIndex];
+			if(node.axis < 0)
+			{
+				for(int position = node.begin; position < node.end; ++position)
+				{
+					const float dx = xs[position] - x, dy = ys[position] - y, dz = zs[position] - z;
+					if(dx*dx + dy*dy + dz*dz <= radius2 && !visit(order[position]))
+						return;
+				}
+				continue;
+			}
+
+			// the far side is only visited when the ball crosses the split
+			const float offset = query[node.axis] - node.split;
+			const int nearChild = offset <= 0 ? nodeIndex + 1 : node.right;
+			const int farChild = offset <= 0 ? node.right : nodeIndex + 1;
+			if(std::fabs(offset) <= radius)
+				stack[top++] = farChild;
+			stack[top++] = nearChild;
+		}
+	}
+
+	// Runs search(query, indices, distances) -> appended count for every query, each
+	// thread appending to its own staging buffers, then stitches them into result
+	template<typename Search>
+	void runBatch(const pcl::PointCloud<PointT>& queries, NeighborLists& result, bool withDistances, int numThreads, Search search) const
+	{
+		const int numQueries = queries.points.size();
+		numThreads = std::max(1, std::min(resolveThreadCount(numThreads), numQueries));
+		result.offsets.resize(numQueries + 1);
+		result.offsets[0] = 0;
+		if(int(result.chunkIndices.size()) < numThreads)
+		{
+			result.chunkIndices.resize(numThreads);
+			result.chunkDistances.resize(numThreads);
+		}
+
+		parallelFor(numQueries, numThreads, [&](int threadId, std::size_t begin, std::size_t end)
+		{
+			std::vector<int>& indices = result.chunkIndices[threadId];
+			std::vector<float>& distances = result.chunkDistances[threadId];
+			indices.clear();
+			distances.clear();
+			for(std::size_t query = begin; query < end; ++query)
+				result.offsets[query + 1] = search(queries.points[query], indices, distances);
+		});
+
+		for(int query = 0; query < numQueries; ++query)
+			result.offsets[query + 1] += result.offsets[query];
+		result.indices.resize(result.offsets[numQueries]);
+		result.distances.resize(withDistances ? result.offsets[numQueries] : 0);
+
+		parallelFor(numQueries, numThreads, [&](int threadId, std::size_t begin, std::size_t end)
+		{
+			if(begin == end)
+				return;
+			const std::vector<int>& indices = result.chunkIndices[threadId];
+			std::copy(indices.begin(), indices.end(), result.indices.begin() + result.offsets[begin]);
+			if(withDistances)
+			{
+				const std::vector<float>& distances = result.chunkDistances[threadId];
+				std::copy(distances.begin(), distances.end(), result.distances.begin() + result.offsets[begin]);
+			}
+		});
+	}
+
+	// max heap on distances2 with indices moved alongside
+	static void heapPush(int* indices, float* distances2, int size, int index, float distance2)
+	{
+		int child = size;
+		while(child > 0)
+		{
+			const int parent = (child - 1) / 2;
+			if(distances2[parent] >= distance2)
+				break;
+			indices[child] = indices[parent];
+			distances2[child] = distances2[parent];
+			child = parent;
+		}
+		indices[child] = index;
+		distances2[child] = distance2;
+	}
+
+	static void heapReplaceTop(int* indices, float* distances2, int size, int index, float distance2)
+	{
+		indices[0] = index;
+		distances2[0] = distance2;
+		heapSiftDown(indices, distances2, 0, size);
+	}
+
+	static void heapSiftDown(int* indices, float* distances2, int parent, int size)
+	{
+		const int index = indices[parent];
+		const float distance2 = distances2[parent];
+		while(true)
+		{
+			int child = 2 * parent + 1;
+			if(child >= size)
+				break;
+			if(child + 1 < size && distances2[child + 1] > distances2[child])
+				++child;
+			if(distances2[child] <= distance2)
+				break;
+			indices[parent] = indices[child];
+			distances2[parent] = distances2[child];
+			parent = child;
+		}
+		indices[parent] = index;
+		distances2[parent] = distance2;
+	}
+
+	int buildNode(int begin, int end)
+	{
+		const int nodeIndex = nodes.size();
+		nodes.push_back(Node{-1, 0.f, -1, begin, end});
+		if(end - begin <= leafSize)
+			return nodeIndex;
+
+		// split the axis of largest extent at its median
+		float lower[3], upper[3];
+		for(int axis = 0; axis < 3; ++axis)
+		{
+			lower[axis] = upper[axis] = coords[axis][order[begin]];
+			for(int position = begin + 1; position < end; ++position)
+			{
+				const float value = coords[axis][order[position]];
+				lower[axis] = std::min(lower[axis], value);
+				upper[axis] = std::max(upper[axis], value);
+			}
+		}
+		int axis = 0;
+		for(int candidate = 1; candidate < 3; ++candidate)
+			if(upper[candidate] - lower[candidate] > upper[axis] - lower[axis])
+				axis = candidate;
+		if(upper[axis] == lower[axis])
+			return nodeIndex;  // all points identical, keep them in one leaf
+
+		const std::vector<float>& values = coords[axis];
+		const int middle = begin + (end - begin) / 2;
+		std::nth_element(order.begin() + begin, order.begin() + middle, order.begin() + end,
+			[&values](int first, int second) { return values[first] < values[second]; });
+
+		const float split = values[order[middle]];
+		buildNode(begin, middle);
+		const int right = buildNode(middle, end);
+		nodes[nodeIndex].axis = axis;
+		nodes[nodeIndex].split = split;
+		nodes[nodeIndex].right = right;
+		return nodeIndex;
+	}
+
+	int leafSize;
+	std::vector<Node> nodes;
+	// original point index for every tree position
+	std::vector<int> order;
+	// x, y, z in tree order once built
+	std::vector<float> coords[3];
+};
+
+#endif /* FLATKDTREE_H */
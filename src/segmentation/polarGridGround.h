@@ -0,0 +1,161 @@
+// Linear time ground segmentation on a polar (azimuth x range) grid
+
+#ifndef POLARGRIDGROUND_H
+#define POLARGRIDGROUND_H
+
+#include <pcl/common/common.h>
+#include <vector>
+#include <algorithm>
+#include <limits>
+#include <cmath>
+
+struct PolarGridParams
+{
+	int numSectors = 180;           // azimuth sectors over the full revolution
+	float binSize = 0.5f;           // radial length of one bin, meters
+	float maxRange = 80.f;          // points further out all fall in the last bin
+	float maxSlope = 0.15f;         // steepest ground slope accepted between bins, rise over run
+	float maxStep = 0.25f;          // height a bin's lowest point may leave the sector line by
+	int lineWindow = 8;             // ground bins the sector line is fitted to
+	float seedRange = 10.f;         // bins nearer than this seed the initial ground height
+};
+
+// Per sector ground line estimation: every point goes to one (sector, bin) cell, the lowest
+// point of each cell is its ground candidate. Walking each sector outwards, a candidate is
+// accepted when it stays near the line fitted to the last lineWindow accepted candidates, the
+// allowed deviation growing with maxSlope over empty stretches, and the line stays flatter than
+// maxSlope, so sloped and curving roads are followed piecewise.
+// Points within distanceThreshold above the line of their cell (or anywhere below it) are
+// ground. Two passes over the points plus one over the cells.
+template<typename PointT>
+struct PolarGridGround
+{
+	PolarGridParams params;
+
+	std::vector<int> pointCells;
+	std::vector<float> pointRanges;
+	std::vector<float> cellLowest;
+	std::vector<float> cellHeight;
+	std::vector<float> cellSlope;
+
+	PolarGridGround(const PolarGridParams& setParams = PolarGridParams())
+		: params(setParams)
+	{}
+
+	int numBins() const { return std::max(1, int(std::ceil(params.maxRange / params.binSize))); }
+
+	// ground[i] is set for every ground point of cloud
+	void segment(const pcl::PointCloud<PointT>& cloud, float distanceThreshold, std::vector<bool>& ground)
+	{
+		const int bins = numBins();
+		const int numCells = params.numSectors * bins;
+		const int numPoints = cloud.points.size();
+		const float sectorWidth = float(2 * M_PI) / params.numSectors;
+
+		pointCells.assign(numPoints, -1);
+		pointRanges.resize(numPoints);
+		cellLowest.assign(numCells, std::numeric_limits<float>::max());
+
+		// bin points and keep the lowest of each cell
+		for(int index = 0; index < numPoints; ++index)
+		{
+			const PointT& point = cloud.points[index];
+			if(!std::isfinite(point.x) || !std::isfinite(point.y) || !std::isfinite(point.z))
+				continue;
+			const float range = std::sqrt(point.x*point.x + point.y*point.y);
+			int sector = int((std::atan2(point.y, point.x) + float(M_PI)) / sectorWidth);
+			sector = std::min(std::max(sector, 0), params.numSectors - 1);
+			const int bin = std::min(int(range / params.binSize), bins - 1);
+
+			const int cell = sector * bins + bin;
+			pointCells[index] = cell;
+			pointRanges[index] = range;
+			cellLowest[cell] = std::min(cellLowest[cell], point.z);
+		}
+
+		// initial ground height: median of the lowest points near the sensor
+		std::vector<float> seeds;
+		const int seedBins = std::max(1, std::min(bins, int(params.seedRange / params.binSize)));
+		for(int sector = 0; sector < params.numSectors; ++sector)
+			for(int bin = 0; bin < seedBins; ++bin)
+				if(cellLowest[sector * bins + bin] != std::numeric_limits<float>::max())
+					seeds.push_back(cellLowest[sector * bins + bin]);
+		float seedHeight = 0.f;
+		if(!seeds.empty())
+		{
+			std::nth_element(seeds.begin(), seeds.begin() + seeds.size() / 2, seeds.end());
+			seedHeight = seeds[seeds.size() / 2];
+		}
+
+		// sweep every sector outwards fitting its ground line
+		cellHeight.assign(numCells, seedHeight);
+		cellSlope.assign(numCells, 0.f);
+		std::vector<float> windowRange(params.lineWindow), windowHeight(params.lineWindow);
+		for(int sector = 0; sector < params.numSectors; ++sector)
+		{
+			int accepted = 0;
+			float height = seedHeight, slope = 0.f, lineRange = 0.f, lastRange = 0.f;
+
+			for(int bin = 0; bin < bins; ++bin)
+			{
+				const int cell = sector * bins + bin;
+				const float center = (bin + 0.5f) * params.binSize;
+				const float lowest = cellLowest[cell];
+				const float expected = height + slope * (center - lineRange);
+
+				// the ground may have climbed up to maxSlope over the gap since the last accepted bin
+				const float tolerance = params.maxStep + params.maxSlope * (center - lastRange);
+
+				if(lowest != std::numeric_limits<float>::max() && std::fabs(lowest - expected) <= tolerance)
+				{
+					lastRange = center;
+					windowRange[accepted % params.lineWindow] = center;
+					windowHeight[accepted % params.lineWindow] = lowest;
+					++accepted;
+					fitLine(windowRange, windowHeight, std::min(accepted, params.lineWindow), height, slope, lineRange);
+				}
+
+				cellHeight[cell] = height + slope * (center - lineRange);
+				cellSlope[cell] = slope;
+			}
+		}
+
+		// label points against the line of their cell
+		ground.assign(numPoints, false);
+		for(int index = 0; index < numPoints; ++index)
+		{
+			const int cell = pointCells[index];
+			if(cell < 0)
+				continue;
+			const float center = (cell % bins + 0.5f) * params.binSize;
+			const float groundHeight = cellHeight[cell] + cellSlope[cell] * (pointRanges[index] - center);
+			ground[index] = cloud.points[index].z - groundHeight <= distanceThreshold;
+		}
+	}
+
+	// least squares line through the window, expressed as height at lineRange plus slope,
+	// slope clamped to maxSlope
+	void fitLine(const std::vector<float>& ranges, const std::vector<float>& heights, int count, float& height, float& slope, float& lineRange) const
+	{
+		double sumRange = 0, sumHeight = 0;
+		for(int i = 0; i < count; ++i)
+		{
+			sumRange += ranges[i];
+			sumHeight += heights[i];
+		}
+		const double meanRange = sumRange / count, meanHeight = sumHeight / count;
+
+		double covariance = 0, variance = 0;
+		for(int i = 0; i < count; ++i)
+		{
+			covariance += (ranges[i] - meanRange) * (heights[i] - meanHeight);
+			variance += (ranges[i] - meanRange) * (ranges[i] - meanRange);
+		}
+		slope = variance > 0 ? float(covariance / variance) : 0.f;
+		slope = std::max(-params.maxSlope, std::min(params.maxSlope, slope));
+		height = float(meanHeight);
+		lineRange = float(meanRange);
+	}
+};
+
+#endif /* POLARGRIDGROUND_H */
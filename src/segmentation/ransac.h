@@ -0,0 +1,247 @@
+// Shared pieces of the RANSAC segmentation: stopping rule, statistics, inlier scoring,
+// the multi-threaded hypothesis driver and the generic ransacFit engine
+
+#ifndef RANSAC_H
+#define RANSAC_H
+
+#include <Eigen/Dense>
+#include <vector>
+#include <cmath>
+#include <limits>
+#include <random>
+#include <atomic>
+#include <cstdint>
+#include "../common/parallel.h"
+
+// What the last RANSAC run did, reported per frame
+struct RansacStats
+{
+	int iterations = 0;       // hypotheses drawn
+	int maxIterations = 0;    // upper bound the run was allowed
+	int inliers = 0;          // inliers of the final model
+	int points = 0;           // points the model was fitted to
+	double confidence = 0;    // probability that an outlier free sample was drawn
+	Eigen::Vector4f plane = Eigen::Vector4f::Zero();  // final Ax + By + Cz + D = 0, unit normal
+	bool warmStart = false;   // plane carried over from the previous frame, no sampling
+
+	double inlierRatio() const { return points > 0 ? double(inliers) / points : 0.0; }
+
+	EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+};
+
+// Probability that at least one of iterations samples of sampleSize points was outlier free
+inline double ransacConfidence(double inlierRatio, int sampleSize, int iterations)
+{
+	const double sampleClean = std::pow(inlierRatio, sampleSize);
+	if(sampleClean >= 1.0)
+		return 1.0;
+	return 1.0 - std::pow(1.0 - sampleClean, iterations);
+}
+
+// Iterations needed to draw an outlier free sample with the given confidence
+inline double ransacIterationBound(double confidence, double inlierRatio, int sampleSize)
+{
+	const double sampleClean = std::pow(inlierRatio, sampleSize);
+	if(sampleClean <= 0.0)
+		return std::numeric_limits<double>::max();
+	if(sampleClean >= 1.0)
+		return 0.0;
+	return std::log(1.0 - confidence) / std::log(1.0 - sampleClean);
+}
+
+// Contiguous coordinate arrays the RANSAC models are fitted to, copied once per cloud so
+// the inlier counting loops run over plain floats
+struct PointArrays
+{
+	std::vector<float> xs, ys, zs;
+
+	PointArrays() {}
+
+	template<typename Cloud>
+	explicit PointArrays(const Cloud& cloud)
+	{
+		assign(cloud);
+	}
+
+	template<typename Cloud>
+	void assign(const Cloud& cloud)
+	{
+		const int numPoints = cloud.points.size();
+		xs.resize(numPoints);
+		ys.resize(numPoints);
+		zs.resize(numPoints);
+		for(int index = 0; index < numPoints; ++index)
+		{
+			xs[index] = cloud.points[index].x;
+			ys[index] = cloud.points[index].y;
+			zs[index] = cloud.points[index].z;
+		}
+	}
+
+	int size() const { return xs.size(); }
+};
+
+// Inlier counting and LO-RANSAC refinement for any model of segmentation/ransacModels.h.
+// Model is a template parameter so its inlier test inlines into the counting loop.
+template<typename Model>
+struct RansacScorer
+{
+	typedef typename Model::Coefficients Coefficients;
+
+	const PointArrays& points;
+	Model model;
+	float distanceThreshold;
+
+	RansacScorer(const PointArrays& setPoints, const Model& setModel, float setDistanceThreshold)
+		: points(setPoints), model(setModel), distanceThreshold(setDistanceThreshold)
+	{}
+
+	bool inlier(const Coefficients& coefficients, int index) const
+	{
+		return model.inlier(coefficients, distanceThreshold, points.xs[index], points.ys[index], points.zs[index]);
+	}
+
+	int count(const Coefficients& coefficients) const
+	{
+		const float* xs = points.xs.data();
+		const float* ys = points.ys.data();
+		const float* zs = points.zs.data();
+		const int numPoints = points.size();
+		int inliers = 0;
+		for(int index = 0; index < numPoints; ++index)
+			inliers += model.inlier(coefficients, distanceThreshold, xs[index], ys[index], zs[index]);
+		return inliers;
+	}
+
+	// refit on the inliers while that gains inliers
+	int optimize(Coefficients& coefficients, int inliers, int maxSteps = 3) const
+	{
+		for(int step = 0; step < maxSteps; ++step)
+		{
+			Coefficients refined = coefficients;
+			if(!model.refit(points, distanceThreshold, refined))
+				break;
+			const int refinedInliers = count(refined);
+			if(refinedInliers < inliers)
+				break;
+			const bool improved = refinedInliers > inliers;
+			coefficients = refined;
+			inliers = refinedInliers;
+			if(!improved)
+				break;
+		}
+		return inliers;
+	}
+};
+
+// Spreads up to maxIterations RANSAC hypotheses over numThreads tasks on the shared pool.
+// Task t owns an mt19937 seeded with (seed, t) and an equal share of the iterations.
+// With a confidence set, a task stops once its share of the iteration bound for its own
+// best inlier ratio is reached, which keeps the run independent of scheduling.
+// hypothesis(rng, model) draws a sample, fits model and returns its inlier count (< 0 for
+// a degenerate sample), improve(model, count) may polish a new task best and returns its
+// new count. Task bests are merged through one atomic holding the best
+// (count, task) pair, ties going to the lower task, so results are reproducible for a
+// given seed and thread count.
+template<typename Model, typename Hypothesis, typename Improve>
+int parallelRansac(int maxIterations, int sampleSize, int numPoints, double confidence, int numThreads, unsigned seed, Hypothesis hypothesis, Improve improve, Model& bestModel, int& iterations)
+{
+	numThreads = std::max(1, std::min(resolveThreadCount(numThreads), maxIterations));
+
+	struct TaskBest
+	{
+		Model model;
+		int count = -1;
+		int iterations = 0;
+	};
+	std::vector<TaskBest, Eigen::aligned_allocator<TaskBest>> taskBests(numThreads);
+	std::atomic<uint64_t> best(0);
+
+	auto task = [&](int taskId)
+	{
+		std::seed_seq sequence{seed, unsigned(taskId)};
+		std::mt19937 rng(sequence);
+		const int share = maxIterations / numThreads + (taskId < maxIterations % numThreads ? 1 : 0);
+		double shareBound = share;
+
+		TaskBest& local = taskBests[taskId];
+		Model model;
+		while(local.iterations < share && local.iterations < shareBound)
+		{
+			++local.iterations;
+			int count = hypothesis(rng, model);
+			if(count <= local.count)
+				continue;
+			count = improve(model, count);
+			local.count = count;
+			local.model = model;
+			if(confidence > 0)
+				shareBound = ransacIterationBound(confidence, double(count) / numPoints, sampleSize) / numThreads;
+		}
+
+		// lock-free max over (count, lowest task id)
+		if(local.count < 0)
+			return;
+		const uint64_t packed = (uint64_t(local.count) << 32) | uint64_t(0xffffffffu - unsigned(taskId));
+		uint64_t current = best.load();
+		while(packed > current && !best.compare_exchange_weak(current, packed))
+			;
+	};
+
+	if(numThreads == 1)
+		task(0);
+	else
+		sharedThreadPool().run(numThreads, task);
+
+	iterations = 0;
+	for(const TaskBest& local : taskBests)
+		iterations += local.iterations;
+
+	const uint64_t winner = best.load();
+	if(winner == 0)
+		return 0;
+	bestModel = taskBests[0xffffffffu - unsigned(winner & 0xffffffffu)].model;
+	return int(winner >> 32);
+}
+
+// RANSAC for any model of segmentation/ransacModels.h: every hypothesis draws
+// Model::sampleSize points (a repeated index counts as a degenerate sample), fits the model
+// and counts its inliers. With refine set, new bests and the final model get LO-RANSAC
+// least squares refits. Returns the inlier count of best, 0 when nothing was found.
+template<typename Model>
+int ransacFit(const PointArrays& points, const Model& model, float distanceThreshold, int maxIterations, double confidence, bool refine, int numThreads, unsigned seed, typename Model::Coefficients& best, int& iterations)
+{
+	typedef typename Model::Coefficients Coefficients;
+	const int numPoints = points.size();
+	iterations = 0;
+	if(numPoints < Model::sampleSize || maxIterations <= 0)
+		return 0;
+
+	RansacScorer<Model> scorer(points, model, distanceThreshold);
+
+	auto hypothesis = [&](std::mt19937& rng, Coefficients& coefficients) -> int
+	{
+		std::uniform_int_distribution<int> pick(0, numPoints - 1);
+		int sample[Model::sampleSize];
+		for(int i = 0; i < Model::sampleSize; ++i)
+			sample[i] = pick(rng);
+		for(int i = 0; i < Model::sampleSize; ++i)
+			for(int j = i + 1; j < Model::sampleSize; ++j)
+				if(sample[i] == sample[j])
+					return -1;
+		if(!model.fit(points, sample, coefficients))
+			return -1;
+		return scorer.count(coefficients);
+	};
+	auto improve = [&](Coefficients& coefficients, int count) -> int
+	{
+		return refine ? scorer.optimize(coefficients, count) : count;
+	};
+
+	int count = parallelRansac(maxIterations, Model::sampleSize, numPoints, confidence, numThreads, seed, hypothesis, improve, best, iterations);
+	if(refine && count > 0)
+		count = scorer.optimize(best, count);
+	return count;
+}
+
+#endif /* RANSAC_H */
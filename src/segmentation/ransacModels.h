@@ -0,0 +1,219 @@
+// Models for the generic RANSAC engine: 2D lines, 3D planes and vertical cylinders
+
+#ifndef RANSACMODELS_H
+#define RANSACMODELS_H
+
+#include <Eigen/Dense>
+#include <cmath>
+#include <algorithm>
+#include <limits>
+#include "ransac.h"
+
+// A model tells ransacFit (segmentation/ransac.h)
+//   Coefficients                             what is fitted
+//   sampleSize                               points in a minimal sample
+//   fit(points, sample, coefficients)        exact fit to a minimal sample, false if degenerate
+//   inlier(coefficients, threshold, x, y, z) branch free test used in the counting loop
+//   refit(points, threshold, coefficients)   least squares fit to the current inliers
+
+// Line ax + by + c = 0 in the xy plane with unit normal (a, b), z is ignored
+struct LineModel
+{
+	typedef Eigen::Vector3f Coefficients;
+	enum { sampleSize = 2 };
+
+	bool fit(const PointArrays& points, const int* sample, Coefficients& line) const
+	{
+		const float x1 = points.xs[sample[0]], y1 = points.ys[sample[0]];
+		const float x2 = points.xs[sample[1]], y2 = points.ys[sample[1]];
+		const float a = y1 - y2;
+		const float b = x2 - x1;
+		const float norm = std::sqrt(a*a + b*b);
+		if(norm == 0)
+			return false;
+		line << a / norm, b / norm, (x1 * y2 - x2 * y1) / norm;
+		return true;
+	}
+
+	bool inlier(const Coefficients& line, float threshold, float x, float y, float) const
+	{
+		return std::fabs(line[0]*x + line[1]*y + line[2]) <= threshold;
+	}
+
+	// total least squares: the normal is the direction of least variance of the inliers
+	bool refit(const PointArrays& points, float threshold, Coefficients& line) const
+	{
+		double n = 0, sx = 0, sy = 0, sxx = 0, sxy = 0, syy = 0;
+		for(int index = 0; index < points.size(); ++index)
+		{
+			const float x = points.xs[index], y = points.ys[index];
+			if(!inlier(line, threshold, x, y, 0.f))
+				continue;
+			n += 1;
+			sx += x; sy += y;
+			sxx += x*x; sxy += x*y; syy += y*y;
+		}
+		if(n < 2)
+			return false;
+
+		const Eigen::Vector2d centroid(sx / n, sy / n);
+		Eigen::Matrix2d covariance;
+		covariance << sxx / n - centroid[0]*centroid[0], sxy / n - centroid[0]*centroid[1],
+					  sxy / n - centroid[0]*centroid[1], syy / n - centroid[1]*centroid[1];
+		Eigen::SelfAdjointEigenSolver<Eigen::Matrix2d> solver(covariance);
+		Eigen::Vector2d normal = solver.eigenvectors().col(0);
+		if(!normal.allFinite() || normal.norm() == 0)
+			return false;
+		normal.normalize();
+		line << float(normal[0]), float(normal[1]), float(-normal.dot(centroid));
+		return true;
+	}
+};
+
+// Plane Ax + By + Cz + D = 0 with unit normal (A, B, C)
+struct PlaneModel
+{
+	typedef Eigen::Vector4f Coefficients;
+	enum { sampleSize = 3 };
+
+	bool fit(const PointArrays& points, const int* sample, Coefficients& plane) const
+	{
+		const int index1 = sample[0], index2 = sample[1], index3 = sample[2];
+
+		// Use point1 as a reference and define two vectors on the plane v1 and v2
+		const float v1x = points.xs[index2] - points.xs[index1];
+		const float v1y = points.ys[index2] - points.ys[index1];
+		const float v1z = points.zs[index2] - points.zs[index1];
+
+		const float v2x = points.xs[index3] - points.xs[index1];
+		const float v2y = points.ys[index3] - points.ys[index1];
+		const float v2z = points.zs[index3] - points.zs[index1];
+
+		// Normal is the cross product v1 x v2, normalised once so inlier tests need no sqrt
+		const float a = v1y * v2z - v1z * v2y;
+		const float b = v1z * v2x - v1x * v2z;
+		const float c = v1x * v2y - v1y * v2x;
+		const float norm = std::sqrt(a*a + b*b + c*c);
+		if(norm == 0)
+			return false;  // collinear sample
+		plane << a / norm, b / norm, c / norm, 0;
+		plane[3] = -(plane[0]*points.xs[index1] + plane[1]*points.ys[index1] + plane[2]*points.zs[index1]);
+		return true;
+	}
+
+	bool inlier(const Coefficients& plane, float threshold, float x, float y, float z) const
+	{
+		return std::fabs(plane[0]*x + plane[1]*y + plane[2]*z + plane[3]) <= threshold;
+	}
+
+	// Total least squares on the inliers, accumulated as moments so no inlier list is built
+	bool refit(const PointArrays& points, float threshold, Coefficients& plane) const
+	{
+		double n = 0, sx = 0, sy = 0, sz = 0, sxx = 0, sxy = 0, sxz = 0, syy = 0, syz = 0, szz = 0;
+		for(int index = 0; index < points.size(); ++index)
+		{
+			const float x = points.xs[index], y = points.ys[index], z = points.zs[index];
+			if(!inlier(plane, threshold, x, y, z))
+				continue;
+			n += 1;
+			sx += x; sy += y; sz += z;
+			sxx += x*x; sxy += x*y; sxz += x*z;
+			syy += y*y; syz += y*z; szz += z*z;
+		}
+		if(n < 3)
+			return false;
+
+		const Eigen::Vector3d centroid(sx / n, sy / n, sz / n);
+		Eigen::Matrix3d covariance;
+		covariance << sxx / n - centroid[0]*centroid[0], sxy / n - centroid[0]*centroid[1], sxz / n - centroid[0]*centroid[2],
+					  sxy / n - centroid[0]*centroid[1], syy / n - centroid[1]*centroid[1], syz / n - centroid[1]*centroid[2],
+					  sxz / n - centroid[0]*centroid[2], syz / n - centroid[1]*centroid[2], szz / n - centroid[2]*centroid[2];
+
+		// normal is the direction of least variance
+		Eigen::SelfAdjointEigenSolver<Eigen::Matrix3d> solver(covariance);
+		Eigen::Vector3d normal = solver.eigenvectors().col(0);
+		if(!normal.allFinite() || normal.norm() == 0)
+			return false;
+		normal.normalize();
+		plane << float(normal[0]), float(normal[1]), float(normal[2]), float(-normal.dot(centroid));
+		return true;
+	}
+};
+
+// Cylinder with a vertical axis, such as a pole or a tree trunk: axis through (cx, cy),
+// radius r. Only the xy projection matters, so the minimal sample is the circle through
+// three points. Radii outside [minRadius, maxRadius] are rejected as degenerate.
+struct VerticalCylinderModel
+{
+	typedef Eigen::Vector3f Coefficients;  // cx, cy, r
+	enum { sampleSize = 3 };
+
+	float minRadius;
+	float maxRadius;
+
+	VerticalCylinderModel(float setMinRadius = 0.f, float setMaxRadius = std::numeric_limits<float>::max())
+		: minRadius(setMinRadius), maxRadius(setMaxRadius)
+	{}
+
+	bool fit(const PointArrays& points, const int* sample, Coefficients& cylinder) const
+	{
+		// circumcircle relative to the first point
+		const float ax = points.xs[sample[0]], ay = points.ys[sample[0]];
+		const float bx = points.xs[sample[1]] - ax, by = points.ys[sample[1]] - ay;
+		const float cx = points.xs[sample[2]] - ax, cy = points.ys[sample[2]] - ay;
+		const float denominator = 2 * (bx * cy - by * cx);
+		if(denominator == 0)
+			return false;  // collinear in xy
+		const float b2 = bx*bx + by*by, c2 = cx*cx + cy*cy;
+		const float ux = (cy * b2 - by * c2) / denominator;
+		const float uy = (bx * c2 - cx * b2) / denominator;
+		cylinder << ax + ux, ay + uy, std::sqrt(ux*ux + uy*uy);
+		return radiusAllowed(cylinder[2]);
+	}
+
+	// compares squared distances to the axis against the squared band edges, no sqrt
+	bool inlier(const Coefficients& cylinder, float threshold, float x, float y, float) const
+	{
+		const float inner = std::max(cylinder[2] - threshold, 0.f);
+		const float outer = cylinder[2] + threshold;
+		const float dx = x - cylinder[0], dy = y - cylinder[1];
+		const float distance2 = dx*dx + dy*dy;
+		return (distance2 >= inner*inner) & (distance2 <= outer*outer);
+	}
+
+	// Algebraic (Kasa) circle fit on the inliers: x^2 + y^2 + Dx + Ey + F = 0 in the least
+	// squares sense, solved from moments centred on the current axis
+	bool refit(const PointArrays& points, float threshold, Coefficients& cylinder) const
+	{
+		Eigen::Matrix3d normal = Eigen::Matrix3d::Zero();
+		Eigen::Vector3d rhs = Eigen::Vector3d::Zero();
+		int n = 0;
+		for(int index = 0; index < points.size(); ++index)
+		{
+			const float x = points.xs[index], y = points.ys[index];
+			if(!inlier(cylinder, threshold, x, y, 0.f))
+				continue;
+			const Eigen::Vector3d row(x - cylinder[0], y - cylinder[1], 1.0);
+			normal += row * row.transpose();
+			rhs -= row * (row[0]*row[0] + row[1]*row[1]);
+			++n;
+		}
+		if(n < 3)
+			return false;
+
+		const Eigen::Vector3d solution = normal.ldlt().solve(rhs);
+		const double ux = -solution[0] / 2, uy = -solution[1] / 2;
+		const double r2 = ux*ux + uy*uy - solution[2];
+		if(!solution.allFinite() || r2 <= 0)
+			return false;
+		cylinder << float(cylinder[0] + ux), float(cylinder[1] + uy), float(std::sqrt(r2));
+		return radiusAllowed(cylinder[2]);
+	}
+
+	bool radiusAllowed(float radius) const
+	{
+		return std::isfinite(radius) && radius >= minRadius && radius <= maxRadius;
+	}
+};
+
+#endif /* RANSACMODELS_H */
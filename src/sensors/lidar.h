@@ -1,6 +1,8 @@
 #ifndef LIDAR_H
 #define LIDAR_H
 #include "../render/render.h"
+#include "rangeImage.h"
+#include "../common/metrics.h"
 #include <ctime>
 #include <chrono>
 
@@ -81,6 +83,10 @@ struct Lidar
 	double maxDistance;
 	double resoultion;
 	double sderr;
+	int numLayers;
+	double steepestAngle;
+	double angleRange;
+	double horizontalAngleInc;
 
 	Lidar(std::vector<Car> setCars, double setGroundSlope)
 		: cloud(new pcl::PointCloud<pcl::PointXYZ>()), position(0,0,2.6)
@@ -95,12 +101,12 @@ struct Lidar
 		groundSlope = setGroundSlope;
 
 		// TODO:: increase number of layers to 8 to get higher resoultion pcd
-		int numLayers = 8;
+		numLayers = 8;
 		// the steepest vertical angle
-		double steepestAngle =  30.0*(-pi/180);
-		double angleRange = 26.0*(pi/180);
+		steepestAngle =  30.0*(-pi/180);
+		angleRange = 26.0*(pi/180);
 		// TODO:: set to pi/64 to get higher resoultion pcd
-		double horizontalAngleInc = pi/64;
+		horizontalAngleInc = pi/64;
 
 		double angleIncrement = angleRange/numLayers;
 
@@ -119,15 +125,25 @@ struct Lidar
 		// pcl uses boost smart pointers for cloud pointer so we don't have to worry about manually freeing the memory
 	}
 
+	// range image layout matching the rays: one row per layer and one column per
+	// horizontal step, each ray in the middle of its cell
+	RangeImageGeometry imageGeometry() const
+	{
+		double angleIncrement = angleRange/numLayers;
+		int numColumns = int(std::round(2*M_PI/horizontalAngleInc));
+		return RangeImageGeometry(numLayers, numColumns, steepestAngle - angleIncrement/2, steepestAngle + angleRange - angleIncrement/2,
+								  -M_PI/numColumns, Eigen::Vector3f(position.x, position.y, position.z));
+	}
+
 	pcl::PointCloud<pcl::PointXYZ>::Ptr scan()
 	{
+		static const StageMetrics stageMetrics("lidar_scan");
 		cloud->points.clear();
-		auto startTime = std::chrono::steady_clock::now();
+		StageTimer timer(stageMetrics);
 		for(Ray ray : rays)
 			ray.rayCast(cars, minDistance, maxDistance, cloud, groundSlope, sderr);
-		auto endTime = std::chrono::steady_clock::now();
-		auto elapsedTime = std::chrono::duration_cast<std::chrono::milliseconds>(endTime - startTime);
-		cout << "ray casting took " << elapsedTime.count() << " milliseconds" << endl;
+		const double elapsedMs = timer.stop(rays.size(), cloud->points.size());
+		metrics().log() << "ray casting took " << elapsedMs << " milliseconds" << endl;
 		cloud->width = cloud->points.size();
 		cloud->height = 1; // one dimensional unorganized point cloud dataset
 		return cloud;
@@ -0,0 +1,226 @@
+// Organized (ring x azimuth) view of a spinning lidar scan
+
+#ifndef RANGEIMAGE_H
+#define RANGEIMAGE_H
+
+#include <pcl/common/common.h>
+#include <Eigen/Dense>
+#include <vector>
+#include <cmath>
+#include <limits>
+#include <algorithm>
+
+// Layout of the range image: rows are rings ordered from the steepest downward
+// ring up, columns are azimuth steps counter clockwise starting at azimuthOffset
+struct RangeImageGeometry
+{
+	int numRings;
+	int numColumns;
+	// elevation of the lower edge of ring 0 and upper edge of the last ring, radians
+	float minElevation, maxElevation;
+	// azimuth where column 0 starts, radians
+	float azimuthOffset;
+	// sensor position the angles are measured from
+	Eigen::Vector3f origin;
+	// optional numRings + 1 ascending ring edges for sensors with uneven ring spacing,
+	// rings are evenly spaced between minElevation and maxElevation when empty
+	std::vector<float> ringEdges;
+
+	RangeImageGeometry(int setNumRings, int setNumColumns, float setMinElevation, float setMaxElevation, float setAzimuthOffset = 0, Eigen::Vector3f setOrigin = Eigen::Vector3f::Zero())
+		: numRings(setNumRings), numColumns(setNumColumns), minElevation(setMinElevation), maxElevation(setMaxElevation), azimuthOffset(setAzimuthOffset), origin(setOrigin)
+	{}
+
+	// Clouds without a ring field, such as the data_1 and data_2 frames: estimates numRings
+	// ring elevations by 1D k-means over a fine elevation histogram, started from equal
+	// count bands. Ring edges are placed halfway between neighbouring ring elevations.
+	template<typename PointT>
+	static RangeImageGeometry fromElevation(const pcl::PointCloud<PointT>& cloud, int numRings, int numColumns, Eigen::Vector3f origin = Eigen::Vector3f::Zero())
+	{
+		std::vector<float> elevations;
+		elevations.reserve(cloud.points.size());
+		for(const PointT& point : cloud.points)
+		{
+			const float dx = point.x - origin[0], dy = point.y - origin[1], dz = point.z - origin[2];
+			const float elevation = std::atan2(dz, std::sqrt(dx*dx + dy*dy));
+			if(std::isfinite(elevation))
+				elevations.push_back(elevation);
+		}
+		if(elevations.size() < std::size_t(numRings) || numRings < 2)
+			return RangeImageGeometry(numRings, numColumns, -float(M_PI / 2), float(M_PI / 2), 0.f, origin);
+
+		const float lowest = *std::min_element(elevations.begin(), elevations.end());
+		const float highest = *std::max_element(elevations.begin(), elevations.end());
+		const float binWidth = 0.01f * float(M_PI / 180.0);
+		const int numBins = std::max(1, int((highest - lowest) / binWidth) + 1);
+		std::vector<int> histogram(numBins, 0);
+		for(float elevation : elevations)
+			++histogram[std::min(numBins - 1, int((elevation - lowest) / binWidth))];
+
+		// equal count start, then Lloyd iterations on the histogram
+		std::vector<double> centers(numRings);
+		{
+			const double perRing = double(elevations.size()) / numRings;
+			double seen = 0;
+			int ring = 0;
+			for(int bin = 0; bin < numBins && ring < numRings; ++bin)
+			{
+				seen += histogram[bin];
+				while(ring < numRings && seen >= (ring + 0.5) * perRing)
+					centers[ring++] = lowest + (bin + 0.5) * binWidth;
+			}
+			for(; ring < numRings; ++ring)
+				centers[ring] = highest;
+		}
+		std::vector<double> sums(numRings), counts(numRings);
+		for(int iteration = 0; iteration < 30; ++iteration)
+		{
+			std::fill(sums.begin(), sums.end(), 0.0);
+			std::fill(counts.begin(), counts.end(), 0.0);
+			int ring = 0;
+			for(int bin = 0; bin < numBins; ++bin)
+			{
+				if(histogram[bin] == 0)
+					continue;
+				const double elevation = lowest + (bin + 0.5) * binWidth;
+				while(ring + 1 < numRings && elevation > 0.5 * (centers[ring] + centers[ring + 1]))
+					++ring;
+				sums[ring] += histogram[bin] * elevation;
+				counts[ring] += histogram[bin];
+			}
+			for(ring = 0; ring < numRings; ++ring)
+				if(counts[ring] > 0)
+					centers[ring] = sums[ring] / counts[ring];
+			std::sort(centers.begin(), centers.end());
+		}
+
+		RangeImageGeometry geometry(numRings, numColumns, lowest, highest + binWidth, 0.f, origin);
+		geometry.ringEdges.resize(numRings + 1);
+		geometry.ringEdges.front() = geometry.minElevation;
+		geometry.ringEdges.back() = geometry.maxElevation;
+		for(int ring = 1; ring < numRings; ++ring)
+			geometry.ringEdges[ring] = float(0.5 * (centers[ring - 1] + centers[ring]));
+		return geometry;
+	}
+
+	// ring an elevation falls in, -1 when outside the image
+	int ringOf(float elevation) const
+	{
+		if(!(elevation >= minElevation && elevation < maxElevation))
+			return -1;
+		if(ringEdges.empty())
+			return std::min(numRings - 1, int((elevation - minElevation) / ringHeight()));
+		return int(std::upper_bound(ringEdges.begin() + 1, ringEdges.end() - 1, elevation) - ringEdges.begin()) - 1;
+	}
+
+	float ringHeight() const { return (maxElevation - minElevation) / numRings; }
+	float columnWidth() const { return float(2 * M_PI) / numColumns; }
+};
+
+// Dense grid of point indices with O(1) neighbour access. Every cell keeps the nearest
+// point that projected into it, further points landing in the same cell are dropped.
+template<typename PointT>
+struct RangeImage
+{
+	RangeImageGeometry geometry;
+	typename pcl::PointCloud<PointT>::ConstPtr cloud;
+
+	// index into cloud for every cell (row major), -1 when empty
+	std::vector<int> cells;
+	// distance from the sensor for every cell, 0 when empty
+	std::vector<float> ranges;
+	// cell every point of cloud projected into, -1 when it fell outside the image; the
+	// point is only stored there when cells[pointCells[i]] == i
+	std::vector<int> pointCells;
+	int droppedPoints;
+
+	RangeImage(const RangeImageGeometry& setGeometry)
+		: geometry(setGeometry), droppedPoints(0)
+	{}
+
+	int rows() const { return geometry.numRings; }
+	int cols() const { return geometry.numColumns; }
+
+	int wrapColumn(int col) const
+	{
+		col %= geometry.numColumns;
+		return col < 0 ? col + geometry.numColumns : col;
+	}
+
+	int cellIndex(int row, int col) const { return row * geometry.numColumns + col; }
+
+	int at(int row, int col) const { return cells[cellIndex(row, col)]; }
+
+	// whether point index is the one its cell stores
+	bool stored(int index) const { return pointCells[index] >= 0 && cells[pointCells[index]] == index; }
+
+	float rangeAt(int row, int col) const { return ranges[cellIndex(row, col)]; }
+
+	// point index of the cell dRow rings and dCol columns away, columns wrap around the
+	// full revolution; -1 above the top or below the bottom ring or on an empty cell
+	int neighbor(int row, int col, int dRow, int dCol) const
+	{
+		row += dRow;
+		if(row < 0 || row >= geometry.numRings)
+			return -1;
+		return cells[cellIndex(row, wrapColumn(col + dCol))];
+	}
+
+	void project(const typename pcl::PointCloud<PointT>::ConstPtr& setCloud)
+	{
+		cloud = setCloud;
+		cells.assign(std::size_t(geometry.numRings) * geometry.numColumns, -1);
+		ranges.assign(cells.size(), 0.f);
+		pointCells.assign(cloud->points.size(), -1);
+		droppedPoints = 0;
+
+		const float inverseColumnWidth = 1.f / geometry.columnWidth();
+
+		for(int index = 0; index < int(cloud->points.size()); ++index)
+		{
+			const PointT& point = cloud->points[index];
+			const float dx = point.x - geometry.origin[0];
+			const float dy = point.y - geometry.origin[1];
+			const float dz = point.z - geometry.origin[2];
+			const float planar = std::sqrt(dx*dx + dy*dy);
+			const float range = std::sqrt(planar*planar + dz*dz);
+
+			const int row = geometry.ringOf(std::atan2(dz, planar));
+			if(row < 0)
+			{
+				++droppedPoints;
+				continue;
+			}
+			const int col = wrapColumn(int(std::floor((std::atan2(dy, dx) - geometry.azimuthOffset) * inverseColumnWidth)));
+
+			const int cell = cellIndex(row, col);
+			pointCells[index] = cell;
+			if(cells[cell] >= 0)
+			{
+				++droppedPoints;
+				if(ranges[cell] <= range)
+					continue;
+			}
+			cells[cell] = index;
+			ranges[cell] = range;
+		}
+	}
+
+	// Organized copy of the image (width = columns, height = rings), empty cells are NaN
+	typename pcl::PointCloud<PointT>::Ptr toOrganizedCloud() const
+	{
+		typename pcl::PointCloud<PointT>::Ptr organized(new pcl::PointCloud<PointT>);
+		PointT empty;
+		empty.x = empty.y = empty.z = std::numeric_limits<float>::quiet_NaN();
+
+		organized->points.resize(cells.size(), empty);
+		for(std::size_t cell = 0; cell < cells.size(); ++cell)
+			if(cells[cell] >= 0)
+				organized->points[cell] = cloud->points[cells[cell]];
+		organized->width = geometry.numColumns;
+		organized->height = geometry.numRings;
+		organized->is_dense = false;
+		return organized;
+	}
+};
+
+#endif /* RANGEIMAGE_H */